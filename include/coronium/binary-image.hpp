@@ -22,6 +22,12 @@
 #ifndef CORO_BINARY_H
 #define CORO_BINARY_H
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "loadimage.hh"
 
 // bfd.h requires PACKAGE/PACKAGE_VERSION to be defined
@@ -58,15 +64,39 @@ class Instruction;
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * @class BinaryRaw
  * @brief LoadImage class for dealing with raw hex buffers.
+ *
+ * The image is a set of disjoint regions (a single buffer, or e.g. the segments of a
+ * core dump), each either caller-owned memory or a mapping of a file. Bytes are never
+ * copied into the image. Region bases are relative to the base address set with
+ * setBaseAddress(). Reads starting outside every region throw DataUnavailError.
+ *
+ * patch() changes bytes of the image (never the caller's buffer or the file: the 4 KB
+ * pages of a region it writes to are copied the first time) and records them as
+ * dirty. Every call that
+ * changes what loadFill() returns bumps getGeneration(), so readers that keep bytes of
+ * the image around know when to drop them.
  */
 class BinaryRaw : public LoadImage {
 private:
-    uint1* binaryBuffer = nullptr;
-    int4 binsize;               // size of binary
+    struct Region {
+        uintb base;             // first address of the region
+        uintb size;             // number of bytes
+        const uint1* data;
+        std::map<uintb, std::unique_ptr<uint1[]>> pages; // patched pages, by page number
+        auto read (uint1* ptr, uintb off, uintb len) const -> void;
+        auto write (const uint1* bytes, uintb off, uintb len) -> void;
+    };
+    std::vector<Region> regions; // sorted by base, never overlapping
+    std::vector<std::pair<void*, size_t>> mappings; // file mappings to release
     AddrSpace* spaceid;
     uintb vma;                  // virtual memory base address.
+    RangeList dirty;            // patched addresses
+    uint4 generation = 0;       // bumped by every change of the bytes or the layout
+    // ----------------------------------------
+    auto findRegion (uintb offset) const -> const Region*;
 public:
-    BinaryRaw (uint1* buffer, int4 sz); // For opening raw buffers
+    BinaryRaw();                // Empty image, see addRegion()/mapFile()
+    BinaryRaw (const uint1* buffer, uintb sz); // For opening raw buffers
     BinaryRaw (BinaryRaw* other) = delete;
     virtual ~BinaryRaw ();
     // pure virtual  overrides ----------------
@@ -74,6 +104,15 @@ public:
     std::string getArchType (void) const override { return "unknown"; };
     void adjustVma(long adjust) override;
     // ----------------------------------------
+    auto addRegion (uintb base, const uint1* data, uintb size) -> void;
+    auto mapFile (uintb base, const std::string& path, uintb offset = 0, uintb size = ~(uintb)0) -> void;
+    auto getSize() const -> uintb;
+    auto getExtent (const Address& addr) const -> uintb;
+    auto getGap (const Address& addr) const -> uintb;
+    auto patch (const Address& addr, const uint1* bytes, uintb size) -> void;
+    auto getDirty() const -> const RangeList& { return dirty; }
+    auto clearDirty() -> void { dirty.clear(); }
+    auto getGeneration() const -> uint4 { return generation; }
     auto attachToSpace (AddrSpace* id) -> void { spaceid = id; }
     void setBaseAddress (uintb addr);
     Address getAddress (uintb addr) { return Address (spaceid, addr); }
@@ -85,9 +124,29 @@ public:
  * @brief LoadImage class for dealing with Binary Files.
  *
  * Originally based on the LoadImageBfd.
+ *
+ * By default the file is mapped into memory once and loadFill() copies straight out
+ * of the mapping, BFD is only used to parse the headers. In this mode loadFill() has
+ * no mutable state and may be called from several threads at once. Passing
+ * usemap = false (or a file that cannot be mapped) falls back to reading through BFD
+ * into a small buffer.
+ *
+ * A mapped Binary can be patched in memory (the mapping is private, the file is never
+ * written), patched addresses are recorded as dirty. As for BinaryRaw, getGeneration()
+ * changes with every patch, adjustVma(), open() and close().
  */
 class Binary : public LoadImage {
 private:
+    /**
+     * @brief One section of the interval index, and where its bytes live.
+     */
+    struct SectionMap {
+        uintb vma;              // address of the first byte
+        uintb size;             // number of bytes
+        uintb maxend;           // greatest vma + size of this and every earlier entry
+        asection* sec;
+        const uint1* data;      // contents in the mapping, nullptr if not mapped
+    };
     static int4 bfdinit;		// Is the library (globally) initialized
     string target;              // File format (supported by BFD)
     bfd *thebfd;
@@ -96,10 +155,24 @@ private:
     uintb bufoffset;            // Starting offset of byte buffer
     uint4 bufsize;              // Number of bytes in the buffer
     uint1 *buffer;              // The actual buffer
+    // section index --------------------------
+    std::vector<SectionMap> sections; // sorted by vma
+    mutable std::atomic<size_t> lasthit { 0 }; // entry that answered the last lookup
+    // mapping --------------------------------
+    bool usemap;                // Serve loadFill from a mapping of the file
+    uint1* mapbase = nullptr;   // The mapped file
+    size_t mapsize = 0;
+    std::mutex bfdlock;         // Guards BFD reads of sections that are not mapped
+    RangeList dirty;            // patched addresses
+    uint4 generation = 0;       // bumped by every change of the bytes or the layout
     // ----------------------------------------
     asection *findSection(uintb offset,uintb &ssize) const;
+    auto indexSections() -> void;
+    auto mapFile() -> void;
+    auto findEntry (uintb offset) const -> const SectionMap*;
+    auto loadMapped (uint1* ptr, int4 size, const Address& addr) -> void;
 public:
-    Binary (const std::string& f, const std::string& t);
+    Binary (const std::string& f, const std::string& t, bool usemap = true);
     Binary (Binary* other) = delete; // shallow copies issue w/ thebfd.
     virtual ~Binary();
     // pure virtual  overrides ----------------
@@ -112,6 +185,13 @@ public:
     void attachToSpace(AddrSpace *id) { spaceid = id; }
     Address getAddress (uintb addr) { return Address (spaceid, addr); }
     Range getAddressRange (uintb faddr, uintb laddr);
+    auto isMapped() const -> bool { return mapbase != nullptr; }
+    auto getExtent (const Address& addr) const -> uintb;
+    auto getGap (const Address& addr) const -> uintb;
+    auto patch (const Address& addr, const uint1* bytes, uintb size) -> void;
+    auto getDirty() const -> const RangeList& { return dirty; }
+    auto clearDirty() -> void { dirty.clear(); }
+    auto getGeneration() const -> uint4 { return generation; }
 };
 
 
@@ -0,0 +1,56 @@
+/**
+ * @file boundary-map.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_BOUNDARY_MAP_H
+#define CORO_BOUNDARY_MAP_H
+
+#include <vector>
+/* local (ghidra) */
+#include "address.hh"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class BoundaryMap
+ * @brief One bit per byte of a range, set where an instruction starts.
+ *
+ * Produced by Coronium::sweepLengths().
+ */
+class BoundaryMap {
+private:
+    Address start;
+    uintb size;                 // number of bytes covered
+    std::vector<uint8> bits;
+public:
+    BoundaryMap (const Address& addr, uintb sz) : start (addr), size (sz), bits ((sz + 63) / 64) {}
+    auto mark (uintb off) -> void { bits[off >> 6] |= (uint8)1 << (off & 63); }
+    auto isStart (uintb off) const -> bool { return off < size && ((bits[off >> 6] >> (off & 63)) & 1); }
+    auto isStart (const Address& addr) const -> bool;
+    auto getStart() const -> const Address& { return start; }
+    auto getSize() const -> uintb { return size; }
+    auto getBits() const -> const std::vector<uint8>& { return bits; }
+    auto count() const -> size_t;
+    auto offsets() const -> std::vector<uintb>;
+};
+
+}
+
+#endif /* CORO_BOUNDARY_MAP_H */
@@ -0,0 +1,84 @@
+/**
+ * @file context-cache.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CORO_CONTEXT_CACHE_H
+#define CORO_CONTEXT_CACHE_H
+
+#include <vector>
+/* local (ghidra) */
+#include "globalcontext.hh"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @struct ContextRegionStats
+ * @brief Counters of a ContextRegionCache.
+ */
+struct ContextRegionStats
+{
+    uint8 hits = 0;
+    uint8 misses = 0;           // lookups that went to the ContextDatabase
+    uint8 evictions = 0;        // regions dropped to make room
+    uint8 invalidations = 0;    // times every region was dropped
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class ContextRegionCache
+ * @brief ContextCache that keeps the context blobs of several address regions.
+ *
+ * ghidra's ContextCache holds the blob of a single [first,last] range, so decoding
+ * that alternates between regions of different context (ARM/Thumb interworking, flow
+ * following across the image) asks the ContextDatabase on nearly every instruction.
+ * This one keeps up to 'size' ranges and replaces the least recently used.
+ *
+ * The blobs point into the ContextDatabase, so every region must be dropped with
+ * invalidate() whenever the database changes: after an instruction commits context
+ * (globalset), after Coronium::setContext() and after any direct change.
+ */
+class ContextRegionCache {
+private:
+    struct Entry {
+        AddrSpace* space;       // nullptr when empty
+        uintb first;
+        uintb last;
+        const uintm* context;   // owned by the ContextDatabase
+        uint8 lastuse;          // 0 when empty
+    };
+    ContextDatabase* database;
+    std::vector<Entry> entries;
+    size_t mru = 0;             // entry of the previous lookup, tried first
+    uint8 clock = 0;
+    ContextRegionStats stats;
+public:
+    ContextRegionCache (ContextDatabase* db, int4 size);
+    auto lookup (const Address& addr) -> const uintm*;
+    auto getContext (const Address& addr, uintm* buf) -> void;
+    auto invalidate() -> void;
+    auto getDatabase() const -> ContextDatabase* { return database; }
+    auto getSize() const -> int4 { return entries.size(); }
+    auto getStats() const -> const ContextRegionStats& { return stats; }
+    auto resetStats() -> void { stats = ContextRegionStats(); }
+};
+
+}
+
+#endif /* CORO_CONTEXT_CACHE_H */
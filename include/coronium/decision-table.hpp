@@ -0,0 +1,101 @@
+/**
+ * @file decision-table.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_DECISION_TABLE_H
+#define CORO_DECISION_TABLE_H
+
+#include <vector>
+/* local (ghidra) */
+#include "context.hh"
+#include "slghsymbol.hh"
+#include "xml.hh"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class DecisionTable
+ * @brief The decision trees of every subtable of a spec, lowered to flat arrays.
+ *
+ * Built from the <decision> elements of the .sla when the Translator is initialized.
+ * A subtable's tree is walked by indexing the children of each node, which are stored
+ * next to each other, with the field it decides on. The field is read straight from
+ * the instruction bytes of the ParserContext. The candidates of a leaf are matched,
+ * in the spec's order, against mask/value words kept in a single array. resolve()
+ * picks the same Constructor as SubtableSymbol::resolve (DecisionNode::resolve) and
+ * throws the same errors.
+ *
+ * The instruction patterns of a leaf with several candidates are also unpacked into
+ * 16 byte lanes (one mask and one value byte per instruction byte), so that all of
+ * them are tested at once with SSE2 (two lanes per instruction with AVX2, see
+ * CORONIUM_AVX2), or eight bytes at a time without either or with CORONIUM_SCALAR.
+ * Context patterns are then only checked for candidates whose instruction pattern
+ * matched, in order.
+ */
+class DecisionTable {
+private:
+    enum Kind : uint1 { INSTRUCTION, CONTEXT, LEAF };
+    struct Node {
+        Kind kind;
+        uint1 size;             // bits of the field
+        uint1 nbytes;           // instruction bytes covering the field (0: read through the walker)
+                                // leaf: bytes its patterns reach (0: not unpacked into lanes)
+        uint1 lshift, rshift;   // moves the field to the bottom of the nbytes read
+        uint1 byte;             // first of those bytes, relative to the operand
+        uint2 startbit;
+        uint4 first;            // first child (decision) or candidate (leaf)
+        uint4 count;            // number of candidates (leaf)
+    };
+    struct Block {
+        int4 offset = 0;
+        int4 nonzero = 0;       // 0: always matches, < 0: never matches
+        uint4 word = 0;         // index into 'words'
+        uint4 nwords = 0;
+    };
+    struct Candidate {
+        Constructor* ct;
+        Block instr, context;
+    };
+    struct alignas (16) Lane {
+        uint1 bytes[16];
+    };
+    std::vector<int4> roots;    // symbol id -> root node, -1 if not a subtable
+    std::vector<Node> nodes;
+    std::vector<Candidate> candidates;
+    std::vector<uintm> words;   // mask, value, mask, value...
+    std::vector<Lane> lanemask; // per candidate, in leaves unpacked into lanes
+    std::vector<Lane> lanevalue;
+    // ----------------------------------------
+    auto lower (const Element* el, SubtableSymbol* sub, uint4 at) -> void;
+    auto readBlock (const Element* el) -> Block;
+    auto unpackLeaf (Node& leaf) -> void;
+    auto matchLeaf (const Node& leaf, ParserWalker& walker, const uint1* buf, uint4 base) const -> Constructor*;
+    auto isMatch (const Block& blk, bool context, ParserWalker& walker, const uint1* buf,
+                  uint4 base) const -> bool;
+public:
+    DecisionTable (const Element* sleigh, const SymbolTable& symtab);
+    auto getRoot (uintm id) const -> int4 { return id < roots.size() ? roots[id] : -1; }
+    auto resolve (int4 root, ParserWalker& walker, const uint1* buf) const -> Constructor*;
+    auto getNumNodes() const -> size_t { return nodes.size(); }
+};
+
+}
+
+#endif /* CORO_DECISION_TABLE_H */
@@ -0,0 +1,99 @@
+/**
+ * @file decode-cache.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_DECODE_CACHE_H
+#define CORO_DECODE_CACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+/* local (ghidra) */
+#include "address.hh"
+#include "loadimage.hh"
+/* local (coronium) */
+#include "emitters.hpp"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @struct DecodeCacheStats
+ * @brief Counters of a DecodeCache.
+ */
+struct DecodeCacheStats
+{
+    uint8 hits = 0;
+    uint8 misses = 0;
+    uint8 evictions = 0;        // entries dropped to stay within the budget
+    uint8 invalidations = 0;    // entries dropped because their bytes changed or by invalidate()
+    size_t entries = 0;
+    size_t bytes = 0;           // approximate memory held by the entries
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class DecodeCache
+ * @brief LRU cache of decoded Instructions, keyed by address and context.
+ *
+ * An entry is keyed by the address of the instruction and the context words in
+ * effect there, so a change of context simply misses. Each entry also keeps the
+ * instruction bytes, which are compared against the image on every hit; an entry
+ * whose bytes changed is dropped. Entries own their pcode (a private PcodeArena),
+ * and Instructions handed out share it, so evicting an entry never invalidates a
+ * copy held by the caller. Not thread safe.
+ */
+class DecodeCache {
+private:
+    struct Key {
+        Address addr;
+        std::vector<uintm> context;
+        auto operator== (const Key& other) const -> bool { return addr == other.addr && context == other.context; }
+    };
+    struct KeyHash {
+        auto operator() (const Key& key) const -> size_t;
+    };
+    struct Entry {
+        Key key;
+        Instruction insn;
+        std::vector<uint1> bytes;
+        size_t footprint;       // approximate memory used by the entry
+    };
+    std::list<Entry> lru;       // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> table;
+    size_t budget;              // in bytes
+    DecodeCacheStats stats;
+    // ----------------------------------------
+    auto erase (std::list<Entry>::iterator it) -> void;
+    auto shrink (size_t target) -> void;
+public:
+    DecodeCache (size_t budget);
+    auto lookup (const Address& addr, const std::vector<uintm>& context, LoadImage* loader) -> const Instruction*;
+    auto insert (const Address& addr, const std::vector<uintm>& context, const Instruction& insn,
+                 LoadImage* loader) -> void;
+    auto invalidate (const Range& rng) -> void;
+    auto clear() -> void;
+    auto setBudget (size_t bytes) -> void;
+    auto getBudget() const -> size_t { return budget; }
+    auto getStats() const -> const DecodeCacheStats& { return stats; }
+    auto resetStats() -> void;
+};
+
+}
+
+#endif /* CORO_DECODE_CACHE_H */
@@ -0,0 +1,103 @@
+/**
+ * @file decode-stats.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_DECODE_STATS_H
+#define CORO_DECODE_STATS_H
+
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>          // __rdtsc
+#endif
+/* local (ghidra) */
+#include "types.h"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @struct DecodeStats
+ * @brief Counters for the stages of the decode pipeline.
+ *
+ * Only filled in when the library is built with -DCORONIUM_STATS=ON (which defines
+ * CORO_STATS), otherwise every counter stays 0. The layout does not depend on the
+ * option. Stages are exclusive: RESOLVE does not include the LOADFILL it triggers.
+ * Cycles are TSC ticks on x86 and nanoseconds elsewhere.
+ */
+struct DecodeStats
+{
+    enum Stage {
+        LOADFILL,               // reading instruction bytes (byte window or LoadImage)
+        RESOLVE,                // matching constructors (Sleigh::resolve)
+        RESOLVE_HANDLES,        // computing operand handles (Sleigh::resolveHandles)
+        BUILD_PCODE,            // SleighBuilder and relative branch fix-ups
+        EMIT,                   // printing assembly and handing pcode to the emitters
+        NUM_STAGES
+    };
+    uint8 cycles[NUM_STAGES] = {};
+    uint8 calls[NUM_STAGES] = {};
+    uint8 cache_hits = 0;       // a parser cache returned an already resolved parse
+    uint8 cache_misses = 0;
+    uint8 cache_evictions = 0;  // misses that reused the parse of another address
+    uint8 loadfill_bytes = 0;
+    // ----------------------------------------
+    auto operator+= (const DecodeStats& other) -> DecodeStats&;
+    auto reset() -> void { *this = DecodeStats(); }
+    static auto getStageName (Stage stage) -> const char*;
+    static auto isEnabled() -> bool;
+    static auto now() -> uint8
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds> (
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+};
+
+#ifdef CORO_STATS
+/**
+ * @brief Adds the time between its construction and destruction to one stage.
+ */
+class StageTimer {
+private:
+    DecodeStats& stats;
+    DecodeStats::Stage stage;
+    uint8 start;
+public:
+    StageTimer (DecodeStats& s, DecodeStats::Stage st) : stats (s), stage (st), start (DecodeStats::now()) {}
+    ~StageTimer()
+    {
+        stats.cycles[stage] += DecodeStats::now() - start;
+        stats.calls[stage] += 1;
+    }
+};
+#define CORO_STATS_CAT2(a, b) a##b
+#define CORO_STATS_CAT(a, b) CORO_STATS_CAT2 (a, b)
+#define CORO_STAGE(stats, stage) StageTimer CORO_STATS_CAT (stage_timer_, __LINE__) (stats, DecodeStats::stage)
+#define CORO_COUNT(expr) (expr)
+#else
+#define CORO_STAGE(stats, stage)
+#define CORO_COUNT(expr)
+#endif
+
+}
+
+#endif /* CORO_DECODE_STATS_H */
@@ -35,25 +35,102 @@
 
 namespace coronium {
 
+// forward declare(s)
+class PcodeRaw;
+class RegisterNames;
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class PcodeArena
+ * @brief Flat storage for the pcode of a batch of instructions.
+ *
+ * Ops and varnodes are appended to two contiguous vectors and referenced by index.
+ * All the PcodeRaw emitters filled during one Coronium::dump/disassemble call share
+ * one arena, so releasing a whole dump is a handful of frees instead of one per op
+ * and per varnode.
+ */
+class PcodeArena {
+    friend class PcodeRaw;
+    friend class PcodeOpRef;
+private:
+    struct OpRecord {
+        OpCode opc;
+        int4 out;               // index into 'vnodes' (-1 if no output)
+        uint4 in;               // index of first input in 'vnodes'
+        int4 nin;               // number of inputs
+    };
+    std::vector<OpRecord> ops;
+    std::vector<VarnodeData> vnodes;
+public:
+    auto reserve (size_t nops, size_t nvnodes) -> void { ops.reserve (nops); vnodes.reserve (nvnodes); }
+    auto clear() -> void { ops.clear(); vnodes.clear(); } // keeps capacity
+    auto numOps() const -> size_t { return ops.size(); }
+    auto numVarnodes() const -> size_t { return vnodes.size(); }
+    auto memoryUsage() const -> size_t { return ops.capacity() * sizeof (OpRecord) + vnodes.capacity() * sizeof (VarnodeData); }
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class PcodeOpRef
+ * @brief Lightweight view of one pcode op stored in a PcodeArena.
+ *
+ * Offers the same accessors as ghidra's PcodeOpRaw.
+ */
+class PcodeOpRef {
+private:
+    const PcodeRaw* raw;
+    uint4 index;                // position of the op within its instruction
+    auto record() const -> const PcodeArena::OpRecord&;
+public:
+    PcodeOpRef (const PcodeRaw* r, uint4 i) : raw (r), index (i) {}
+    auto getOpcode() const -> OpCode { return record().opc; }
+    auto getBehavior() const -> OpBehavior*;
+    auto getSeqNum() const -> SeqNum;
+    auto getAddr() const -> const Address&;
+    auto getOutput() const -> VarnodeData*;
+    auto numInput() const -> int4 { return record().nin; }
+    auto getInput (int4 i) const -> VarnodeData*;
+};
+
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * @class PcodeRaw
  * @brief Used to get raw pcode.
+ *
+ * The ops of one instruction are a contiguous slice of a (possibly shared) PcodeArena.
+ * Only one PcodeRaw may be emitting into a given arena at a time.
  */
 class PcodeRaw : public PcodeEmit {
-    friend class Instruction;
+    friend class PcodeOpRef;
 private:
-    void print_varnode (std::ostream&, VarnodeData&);
+    static auto formatVarnode (std::string& out, const VarnodeData& vdata, const Translate*& trans,
+                               const RegisterNames*& names) -> void;
     // ----------------------------------------
-    std::vector<PcodeOpRaw*> pcodeOps;
-    vector<VarnodeData*> vnodes_cache;
-    std::vector<OpBehavior*>& pcode_behaviors;
+    std::shared_ptr<PcodeArena> arena;
+    std::vector<OpBehavior*>* pcode_behaviors;
+    Address address;
+    uint4 first;                // index of our first op in the arena
+    uint4 count = 0;            // number of ops
 public:
+    class const_iterator {
+        const PcodeRaw* raw;
+        uint4 index;
+    public:
+        const_iterator (const PcodeRaw* r, uint4 i) : raw (r), index (i) {}
+        auto operator* () const -> PcodeOpRef { return PcodeOpRef (raw, index); }
+        auto operator++ () -> const_iterator& { ++index; return *this; }
+        auto operator== (const const_iterator& other) const -> bool { return index == other.index; }
+        auto operator!= (const const_iterator& other) const -> bool { return index != other.index; }
+    };
     PcodeRaw (std::vector<OpBehavior*>& behavior);
-    PcodeRaw (PcodeRaw const& other) = default;
-    ~PcodeRaw();
-    void clear_cache (void);
+    PcodeRaw (std::vector<OpBehavior*>& behavior, std::shared_ptr<PcodeArena> storage);
     void dump (const Address& addr, OpCode opc, VarnodeData* outvar, VarnodeData* vars, int4 isize) override;
     void print (std::ostream&);
+    auto format (std::string& out) const -> void;
+    auto clear() -> void { first = arena->ops.size(); count = 0; } // start a new (empty) slice
+    auto size() const -> uint4 { return count; }
+    auto operator[] (uint4 i) const -> PcodeOpRef { return PcodeOpRef (this, i); }
+    auto begin() const -> const_iterator { return const_iterator (this, 0); }
+    auto end() const -> const_iterator { return const_iterator (this, count); }
+    auto getArena() const -> const PcodeArena& { return *arena; }
+    auto getBehaviors() const -> std::vector<OpBehavior*>* { return pcode_behaviors; }
 };
 
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -78,9 +155,6 @@ struct Instruction
     PcodeRaw pcode;
     int4 size;
     Instruction (AssemblyRaw assem, PcodeRaw&& rawpc, int4 sz);
-    Instruction (Instruction const& other);
-    Instruction (Instruction&& other) noexcept;
-    ~Instruction();
 };
 
 }
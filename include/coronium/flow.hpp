@@ -0,0 +1,121 @@
+/**
+ * @file flow.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_FLOW_H
+#define CORO_FLOW_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+/* local (ghidra) */
+#include "address.hh"
+
+namespace coronium {
+
+// forward declare(s)
+class Coronium;
+class PcodeRaw;
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @struct BasicBlock
+ * @brief Straight-line run of instructions entered only at its first one.
+ */
+struct BasicBlock
+{
+    Address start;
+    uint4 size = 0;             // in bytes
+    uint4 ninsns = 0;
+    std::vector<Address> successors; // branch targets and fall-through
+    std::vector<Address> calls;      // direct call targets, in order
+    bool returns = false;       // ends in a RETURN
+    bool indirect = false;      // ends in a BRANCHIND (successors unknown)
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @struct FlowFunction
+ * @brief Blocks reachable from an entry point without following calls.
+ */
+struct FlowFunction
+{
+    Address entry;
+    std::vector<Address> blocks; // sorted, the same block may belong to several functions
+    std::set<Address> callees;
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class FlowGraph
+ * @brief Recursive-descent disassembly of the code of a Coronium image.
+ *
+ * Starting from the entry points, instructions are decoded to pcode and their
+ * BRANCH, CBRANCH, CALL and RETURN ops followed with a worklist. Every address is
+ * claimed once in a bitmap covering the bounds, so nothing is decoded twice, and
+ * targets outside the bounds are recorded but not followed. The worklist can be
+ * shared by several threads. Once it is empty the instructions are cut into basic
+ * blocks and grouped into functions (entry points and call targets) and a call graph.
+ *
+ * With one thread decoding goes through the Coronium's translator and may set
+ * context. With more, each thread has its own DecodeContext and context changes made
+ * by instructions are not applied (as in Coronium::dumpParallel).
+ */
+class FlowGraph {
+private:
+    struct InsnInfo {
+        uint4 length;
+        bool falls;             // execution may continue with the next instruction
+        bool returns;
+        bool indirect;
+        std::vector<Address> branches;
+        std::vector<Address> calls;
+    };
+    Coronium& coro;
+    AddrSpace* space;           // of the bounds
+    uintb first, last;          // bounds (inclusive)
+    std::unique_ptr<std::atomic<uint8>[]> visited; // one bit per byte of the bounds
+    std::vector<Address> entries;
+    std::map<uintb, InsnInfo> insns;
+    std::map<Address, BasicBlock> blocks;
+    std::map<Address, FlowFunction> functions;
+    std::vector<Address> errors; // addresses that did not decode
+    // ----------------------------------------
+    auto inBounds (const Address& addr) const -> bool;
+    auto claim (const Address& addr) -> bool;
+    static auto analyze (const PcodeRaw& pcode, InsnInfo& info) -> void;
+    auto explore (uint4 nthreads) -> void;
+    auto buildBlocks() -> void;
+    auto buildFunctions() -> void;
+public:
+    FlowGraph (Coronium& c, Range bounds);
+    FlowGraph (FlowGraph const& other) = delete;
+    auto addEntry (const Address& addr) -> void;
+    auto run (uint4 nthreads = 1) -> void;
+    auto getBlock (const Address& addr) const -> const BasicBlock*;
+    auto getBlocks() const -> const std::map<Address, BasicBlock>& { return blocks; }
+    auto getFunctions() const -> const std::map<Address, FlowFunction>& { return functions; }
+    auto getCallGraph() const -> std::map<Address, std::set<Address>>;
+    auto getErrors() const -> const std::vector<Address>& { return errors; }
+    auto numInstructions() const -> size_t { return insns.size(); }
+};
+
+}
+
+#endif /* CORO_FLOW_H */
@@ -0,0 +1,128 @@
+/**
+ * @file instruction-batch.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_INSTRUCTION_BATCH_H
+#define CORO_INSTRUCTION_BATCH_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+/* local (ghidra) */
+#include "address.hh"
+#include "opcodes.hh"
+#include "pcoderaw.hh"
+#include "translate.hh"
+/* local (coronium) */
+#include "translator.hpp"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class MnemonicTable
+ * @brief Interned mnemonics of a language, ids are dense and never reused.
+ */
+class MnemonicTable {
+private:
+    std::unordered_map<std::string, uint4> ids;
+    std::vector<std::string> names;
+public:
+    auto intern (const std::string& mnem) -> uint4;
+    auto getName (uint4 id) const -> const std::string& { return names[id]; }
+    auto size() const -> size_t { return names.size(); }
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class InstructionBatch
+ * @brief Column (structure of arrays) storage for many decoded instructions.
+ *
+ * Instruction i has its address, length and mnemonic id in three columns and its
+ * operand text in one shared string. Its ops are [getOpStart(i), getOpStart(i + 1))
+ * of the op columns and each op's varnodes are indexes into the varnode columns. A
+ * batch of N instructions is a few dozen vectors however large N is, and a scan over
+ * one column touches only that column.
+ */
+class InstructionBatch {
+private:
+    class AsmSink : public AssemblyEmit {
+    public:
+        InstructionBatch* batch;
+        void dump (const Address& addr, const std::string& mnem, const std::string& body) override;
+    };
+    class PcodeSink : public PcodeEmit {
+    public:
+        InstructionBatch* batch;
+        void dump (const Address& addr, OpCode opc, VarnodeData* outvar, VarnodeData* vars, int4 isize) override;
+    };
+    std::shared_ptr<MnemonicTable> mnemonics;
+    AddrSpace* space = nullptr; // of the instruction addresses
+    std::vector<AddrSpace*> spaces; // by AddrSpace::getIndex()
+    // instructions ---------------------------
+    std::vector<uintb> addrs;
+    std::vector<uint4> lengths;
+    std::vector<uint4> mnemonic_ids;
+    std::vector<uint4> text_start { 0 }; // operand text of i is [text_start[i], text_start[i + 1])
+    std::string text;
+    std::vector<uint4> op_start { 0 };   // ops of i are [op_start[i], op_start[i + 1])
+    // ops ------------------------------------
+    std::vector<uint1> opcodes;
+    std::vector<int4> op_out;   // varnode index, -1 if none
+    std::vector<uint4> op_in;   // first input varnode
+    std::vector<uint2> op_nin;
+    // varnodes -------------------------------
+    std::vector<uint1> vn_space; // AddrSpace::getIndex()
+    std::vector<uintb> vn_offset;
+    std::vector<uint4> vn_size;
+    // ----------------------------------------
+    auto addVarnode (const VarnodeData& vn) -> uint4;
+    auto truncate (size_t ninsns, size_t nops, size_t nvns) -> void;
+public:
+    InstructionBatch (std::shared_ptr<MnemonicTable> table);
+    auto append (const Translator& trans, DecodeContext& ctx, const Address& addr) -> int4;
+    auto reserve (size_t ninsns, size_t nops) -> void;
+    auto clear() -> void { truncate (0, 0, 0); }
+    // instructions ---------------------------
+    auto size() const -> size_t { return addrs.size(); }
+    auto getAddress (size_t i) const -> Address { return Address (space, addrs[i]); }
+    auto getLength (size_t i) const -> uint4 { return lengths[i]; }
+    auto getMnemonicId (size_t i) const -> uint4 { return mnemonic_ids[i]; }
+    auto getMnemonic (size_t i) const -> const std::string& { return mnemonics->getName (mnemonic_ids[i]); }
+    auto getBody (size_t i) const -> std::string { return text.substr (text_start[i], text_start[i + 1] - text_start[i]); }
+    auto getOpStart (size_t i) const -> uint4 { return op_start[i]; }
+    auto numOps (size_t i) const -> uint4 { return op_start[i + 1] - op_start[i]; }
+    // ops and varnodes -----------------------
+    auto getOpcode (uint4 op) const -> OpCode { return (OpCode)opcodes[op]; }
+    auto getOutput (uint4 op) const -> int4 { return op_out[op]; }
+    auto numInput (uint4 op) const -> uint4 { return op_nin[op]; }
+    auto getInput (uint4 op, uint4 slot) const -> uint4 { return op_in[op] + slot; }
+    auto getVarnode (uint4 vn) const -> VarnodeData;
+    // raw columns ----------------------------
+    auto getAddresses() const -> const std::vector<uintb>& { return addrs; }
+    auto getLengths() const -> const std::vector<uint4>& { return lengths; }
+    auto getMnemonicIds() const -> const std::vector<uint4>& { return mnemonic_ids; }
+    auto getOpcodes() const -> const std::vector<uint1>& { return opcodes; }
+    auto getText() const -> const std::string& { return text; }
+    auto getMnemonics() const -> const MnemonicTable& { return *mnemonics; }
+};
+
+}
+
+#endif /* CORO_INSTRUCTION_BATCH_H */
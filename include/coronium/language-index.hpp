@@ -0,0 +1,77 @@
+/**
+ * @file language-index.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_LANGUAGE_INDEX_H
+#define CORO_LANGUAGE_INDEX_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @struct LanguageRecord
+ * @brief Everything Coronium needs to know about one language id of an .ldefs file.
+ */
+struct LanguageRecord
+{
+    std::string cpu_dir;        // directory holding the .ldefs (does not end in '/')
+    std::string pspec;          // full path of the .pspec ("" if not found)
+    std::unordered_map<std::string, std::string> ldefs; // attributes of the <language> tag
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class LanguageIndex
+ * @brief Map of language id to LanguageRecord for one cpu directory.
+ *
+ * Building the index means crawling the directory tree and parsing every .ldefs file.
+ * The result is saved in the directory as "coronium.index" (the cpus target writes it
+ * at install time) together with the mtime of every .ldefs and .pspec and a hash of
+ * the names in every directory it was built from (leaving out the index and the .sla
+ * packs, which coronium writes there itself). A saved index is only used if none of
+ * those changed. Indexes are also kept in a process wide
+ * registry, so only the first lookup for a directory touches the filesystem.
+ */
+class LanguageIndex {
+private:
+    std::string directory;
+    std::map<std::string, LanguageRecord> languages;
+    std::map<std::string, long long> stamps; // path -> mtime or listing, for invalidation
+    // ----------------------------------------
+    auto crawl() -> void;
+    auto read (const std::string& path) -> bool;
+public:
+    static const char* filename; // "coronium.index"
+    LanguageIndex (std::string dir);
+    static auto get (const std::string& dir) -> std::shared_ptr<LanguageIndex>;
+    static auto clearRegistry() -> void;
+    auto find (const std::string& id) const -> const LanguageRecord*;
+    auto save() -> bool;
+    auto getDirectory() const -> const std::string& { return directory; }
+    auto getLanguages() const -> const std::map<std::string, LanguageRecord>& { return languages; }
+};
+
+}
+
+#endif /* CORO_LANGUAGE_INDEX_H */
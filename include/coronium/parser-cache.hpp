@@ -0,0 +1,80 @@
+/**
+ * @file parser-cache.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_PARSER_CACHE_H
+#define CORO_PARSER_CACHE_H
+
+#include <unordered_map>
+#include <vector>
+/* local (ghidra) */
+#include "sleigh.hh"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class ParserCache
+ * @brief Two-level cache of ParserContext objects for workloads that revisit addresses.
+ *
+ * The first level is a direct-mapped window indexed by the low bits of the address,
+ * like the hashtable of ghidra's DisassemblyCache: one compare on a hit. The second
+ * level is a hash table over a pool of up to 'size' parses, reused least recently used
+ * first, so a parse stays cached until 'size' other addresses were decoded instead of
+ * until the next window conflict or 'cachesize' misses. ParserContexts are allocated
+ * the first time they are needed.
+ */
+class ParserCache {
+private:
+    struct Entry {
+        ParserContext* pos;
+        Entry* prev;
+        Entry* next;
+    };
+    struct AddressHash {
+        auto operator() (const Address& addr) const -> size_t
+        {
+            return std::hash<uintb>() (addr.getOffset()) ^ std::hash<const void*>() (addr.getSpace());
+        }
+    };
+    ContextCache* contextcache;
+    AddrSpace* constspace;
+    int4 capacity;
+    uint4 mask;                 // window size - 1
+    std::vector<Entry*> window;
+    std::vector<Entry> entries; // reserved up front, never moves
+    std::unordered_map<Address, Entry*, AddressHash> table;
+    Entry lru;                  // sentinel: lru.next is the most recently used entry
+    // ----------------------------------------
+    auto unlink (Entry* e) -> void;
+    auto pushFront (Entry* e) -> void;
+public:
+    ParserCache (ContextCache* ccache, AddrSpace* cspace, int4 size, int4 windowsize);
+    ParserCache (ParserCache const& other) = delete;
+    ~ParserCache();
+    auto lookup (const Address& addr) -> ParserContext*;
+    auto insert (const Address& addr, bool& evicted) -> ParserContext*;
+    auto clear() -> void;
+    auto getSize() const -> int4 { return capacity; }
+    auto getWindowSize() const -> int4 { return mask + 1; }
+};
+
+}
+
+#endif /* CORO_PARSER_CACHE_H */
@@ -0,0 +1,220 @@
+/**
+ * @file pcode-file.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_PCODE_FILE_H
+#define CORO_PCODE_FILE_H
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+/* local (ghidra) */
+#include "opcodes.hh"
+/* local (coronium) */
+#include "emitters.hpp"
+
+namespace coronium {
+
+/*
+ * File layout (integers are LEB128 varints unless noted):
+ *
+ *   "CORPCD1\n"
+ *   instruction records, each one being
+ *       record length (bytes after this field), space, offset, length,
+ *       mnemonic id, body length, body bytes, number of ops,
+ *       and per op: opcode (1 byte), (number of inputs << 1 | has output),
+ *       output varnode if any, input varnodes
+ *   tables: spaces (names), mnemonics, registers (space, offset, size, name)
+ *   trailer: tables offset (8 bytes LE), number of instructions (8 bytes LE), "CORPCD1\n"
+ *
+ * A varnode is space, offset, size. Strings are a length followed by the bytes.
+ */
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class PcodeWriter
+ * @brief Writes a stream of Instructions in the compact binary pcode format.
+ *
+ * Spaces, mnemonics and the names of the registers used are interned and written
+ * once, in tables at the end of the file. Only close() writes them and the trailer: a
+ * writer destroyed before (e.g. unwinding from a decoding error) removes the file
+ * rather than leave one that looks complete.
+ */
+class PcodeWriter {
+private:
+    struct RegKey {
+        uint4 space;
+        uintb offset;
+        uint4 size;
+        auto operator< (const RegKey& other) const -> bool
+        {
+            if (space != other.space) return space < other.space;
+            if (offset != other.offset) return offset < other.offset;
+            return size < other.size;
+        }
+    };
+    std::string path;
+    std::ofstream out;
+    std::string record;         // record being built (reused)
+    uint8 position = 0;         // bytes written so far
+    uint8 ninsns = 0;
+    std::unordered_map<const AddrSpace*, uint4> space_ids;
+    std::vector<std::string> space_names;
+    std::unordered_map<std::string, uint4> mnemonic_ids;
+    std::vector<std::string> mnemonic_names;
+    std::map<RegKey, std::string> registers;
+    const Translate* trans = nullptr;
+    const RegisterNames* regnames = nullptr;
+    // ----------------------------------------
+    auto spaceId (const AddrSpace* space) -> uint4;
+    auto putVarnode (const VarnodeData& vn) -> void;
+public:
+    PcodeWriter (const std::string& path);
+    PcodeWriter (PcodeWriter const& other) = delete;
+    ~PcodeWriter();
+    auto write (const Instruction& insn) -> void;
+    auto close() -> void;
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class PcodeReader
+ * @brief Reads a file written by PcodeWriter through mmap.
+ *
+ * Nothing is copied or allocated while iterating: instructions and ops are views
+ * that decode their fields straight out of the mapping, and strings point into it.
+ * Every record is checked once when the file is opened, a corrupt file throws there.
+ */
+class PcodeReader {
+public:
+    /**
+     * @brief A string inside the mapping (not NUL terminated).
+     */
+    struct Text {
+        const char* data;
+        uint4 size;
+        auto str() const -> std::string { return std::string (data, size); }
+    };
+    struct Varnode {
+        uint4 space;            // index into the space table, see getSpaceName()
+        uintb offset;
+        uint4 size;
+    };
+    class Op {
+        friend class PcodeReader;
+    private:
+        const uint1* inputs;    // encoded inputs
+        const uint1* next;      // first byte after this op
+        Varnode out;
+    public:
+        OpCode opcode;
+        uint4 ninputs;
+        bool has_output;
+        auto getOutput() const -> const Varnode* { return has_output ? &out : nullptr; }
+        auto getInput (uint4 i) const -> Varnode; // decodes inputs 0..i
+    };
+    class Insn {
+        friend class PcodeReader;
+    private:
+        const PcodeReader* reader;
+        const uint1* ops;       // encoded ops
+        const uint1* next;      // next record
+    public:
+        uint4 space;
+        uintb offset;
+        uint4 length;
+        uint4 mnemonic;
+        Text body;
+        uint4 nops;
+        auto getMnemonic() const -> Text { return reader->getMnemonic (mnemonic); }
+        template <typename F> auto forEachOp (F visit) const -> void;
+    };
+    class const_iterator {
+        const PcodeReader* reader;
+        const uint1* pos;
+        Insn insn;
+    public:
+        const_iterator (const PcodeReader* r, const uint1* p);
+        auto operator* () const -> const Insn& { return insn; }
+        auto operator-> () const -> const Insn* { return &insn; }
+        auto operator++ () -> const_iterator&;
+        auto operator== (const const_iterator& other) const -> bool { return pos == other.pos; }
+        auto operator!= (const const_iterator& other) const -> bool { return pos != other.pos; }
+    };
+private:
+    struct RegKey {
+        uint4 space;
+        uintb offset;
+        uint4 size;
+        auto operator== (const RegKey& other) const -> bool
+        {
+            return space == other.space && offset == other.offset && size == other.size;
+        }
+    };
+    struct RegKeyHash {
+        auto operator() (const RegKey& key) const -> size_t
+        {
+            return std::hash<uintb>() (key.offset * 31 + key.size) ^ key.space;
+        }
+    };
+    const uint1* base = nullptr; // the mapping
+    size_t mapsize = 0;
+    const uint1* records;       // first record
+    const uint1* tables;        // end of the records
+    uint8 ninsns;
+    std::vector<Text> spaces;
+    std::vector<Text> mnemonics;
+    std::unordered_map<RegKey, Text, RegKeyHash> registers;
+    // ----------------------------------------
+    static auto decodeInsn (const PcodeReader* reader, const uint1* pos, Insn& insn) -> void;
+    static auto decodeOp (const uint1* pos, Op& op) -> void;
+public:
+    PcodeReader (const std::string& path);
+    PcodeReader (PcodeReader const& other) = delete;
+    ~PcodeReader();
+    auto size() const -> uint8 { return ninsns; }
+    auto begin() const -> const_iterator { return const_iterator (this, records); }
+    auto end() const -> const_iterator { return const_iterator (this, tables); }
+    auto numSpaces() const -> uint4 { return spaces.size(); }
+    auto getSpaceName (uint4 id) const -> Text { return spaces[id]; }
+    auto getMnemonic (uint4 id) const -> Text { return mnemonics[id]; }
+    auto getRegisterName (const Varnode& vn) const -> const Text*;
+};
+
+/**
+ * @brief Call visit(const Op&) on every op of the instruction, in order.
+ */
+template <typename F>
+auto
+PcodeReader::Insn::forEachOp (F visit) const -> void
+
+{
+    Op op;
+    const uint1* pos = ops;
+    for (uint4 i = 0; i != nops; ++i) {
+        decodeOp (pos, op);
+        visit (static_cast<const Op&> (op));
+        pos = op.next;
+    }
+}
+
+}
+
+#endif /* CORO_PCODE_FILE_H */
@@ -0,0 +1,82 @@
+/**
+ * @file session.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_SESSION_H
+#define CORO_SESSION_H
+
+#include <functional>
+#include <string>
+#include <vector>
+/* local (ghidra) */
+#include "address.hh"
+#include "globalcontext.hh"
+#include "loadimage.hh"
+/* local (coronium) */
+#include "emitters.hpp"
+#include "instruction-batch.hpp"
+#include "translator.hpp"
+
+namespace coronium {
+
+// forward declare(s)
+class Binary;
+class BinaryRaw;
+class Coronium;
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class Session
+ * @brief One image decoded through the language loaded by a Coronium.
+ *
+ * The Coronium's Translator (the parsed .sla) is shared, read-only, by all of its
+ * sessions. A session only owns what depends on the image: the LoadImage, a
+ * ContextDatabase holding the .pspec defaults, and a DecodeContext. Creating one costs
+ * opening the file, so many binaries of the same architecture pay the spec load once.
+ * Create sessions from one thread. Once created, different sessions may decode on
+ * different threads at the same time, except for dumpBatch() whose mnemonic table is
+ * shared. The Coronium must outlive its sessions.
+ */
+class Session {
+private:
+    Coronium& coro;
+    Translator* trans;
+    LoadImage* loader = nullptr;
+    ContextDatabase* context = nullptr;
+    DecodeContext* decoder = nullptr;
+    // ----------------------------------------
+    auto setup() -> void;
+public:
+    Session (Coronium& lang, const std::string& f);
+    Session (Coronium& lang, const uint1* imgbuffer, uintb imgsize);
+    Session (Session const& other) = delete;
+    ~Session();
+    auto getBinaryImage() const -> Binary*;
+    auto getBinaryRawImage() const -> BinaryRaw*;
+    auto getContext() const -> ContextDatabase* { return context; }
+    auto getDecodeContext() const -> DecodeContext* { return decoder; }
+    auto disassemble (Address addr, uint4 ninsns = 1) -> std::vector<Instruction>;
+    auto dump (Range rng) -> std::vector<Instruction>;
+    auto dump (Range rng, std::function<bool (Instruction const&)> visit) -> Address;
+    auto dumpBatch (Range rng) -> InstructionBatch;
+};
+
+}
+
+#endif /* CORO_SESSION_H */
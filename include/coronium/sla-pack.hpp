@@ -0,0 +1,51 @@
+/**
+ * @file sla-pack.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_SLA_PACK_H
+#define CORO_SLA_PACK_H
+
+#include <string>
+/* local (ghidra) */
+#include "xml.hh"
+
+namespace coronium {
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class SlaPack
+ * @brief Compact binary image of a compiled .sla document.
+ *
+ * A pack holds the element tree of the .sla with every distinct string stored once.
+ * It is read through mmap and turned back into a DOM without running the XML parser,
+ * which is most of the cost of loading a large spec such as x86-64. The pack lives
+ * next to the .sla (same name plus ".pack") and records the size and mtime of the .sla
+ * it was made from, so an out of date pack is never used.
+ */
+class SlaPack {
+public:
+    static const char* extension; // ".pack"
+    static auto write (const Element* root, const std::string& slafile) -> bool;
+    static auto read (const std::string& slafile) -> Document*;
+    static auto load (const std::string& slafile) -> Document*;
+};
+
+}
+
+#endif /* CORO_SLA_PACK_H */
@@ -0,0 +1,239 @@
+/**
+ * @file translator.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORO_TRANSLATOR_H
+#define CORO_TRANSLATOR_H
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+/* local (ghidra) */
+#include "sleigh.hh"
+#include "globalcontext.hh"
+#include "loadimage.hh"
+/* local (coronium) */
+#include "context-cache.hpp"
+#include "decision-table.hpp"
+#include "decode-stats.hpp"
+#include "parser-cache.hpp"
+
+namespace coronium {
+
+// forward declare(s)
+class Binary;
+class BinaryRaw;
+class Translator;
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class DecodeContext
+ * @brief The mutable half of a Translator.
+ *
+ * Holds the LoadImage bytes are read from (through a window of prefetched bytes), the
+ * caches in front of the ContextDatabase, the caches of ParserContext objects and the
+ * pcode staging buffer. Context is read through a ContextRegionCache, context commits
+ * are written through a ContextCache.
+ * The spec loaded into a Translator is only read while decoding, so several
+ * DecodeContexts (e.g., one per thread) can decode through one Translator at once.
+ * Its DecodeStats are added to the Translator's when it is destroyed.
+ *
+ * With trackContext() on, a cached parse is only reused if the context it was resolved
+ * under is still the context of its address, so instructions decoded after a context
+ * commit (globalset) or a change to the ContextDatabase see the new values.
+ */
+class DecodeContext {
+    friend class Translator;
+private:
+    const Translator& owner;
+    LoadImage* loader;
+    ContextCache ctxcache;
+    ContextRegionCache* contexts = nullptr;
+    DisassemblyCache* discache;
+    ParserCache* parsers = nullptr;     // when Translator::setParserCacheSize is used
+    uint8 ringfills = 0;                // misses that found an unused DisassemblyCache slot
+    BinaryRaw* rawimage = nullptr;      // the loader, if it can tell where its regions end
+    Binary* binimage = nullptr;
+    std::vector<uint1> bytewindow;      // image bytes starting at windowstart
+    Address windowstart;                // invalid while the window is empty
+    int4 windowfill = 0;                // number of bytes in the window
+    uint4 imagegen = 0;                 // generation of the image the caches were filled from
+    PcodeCacher pcode_cache;
+    DecodeStats stats;
+    bool allowset = true;
+    bool trackcontext = false;
+    std::unordered_map<const ParserContext*, std::vector<uintm>> parsedcontext; // when tracking
+    std::vector<uintm> curcontext;
+    std::unordered_set<const ParserContext*> committers; // parses with context commits
+    // ----------------------------------------
+    auto createCaches() -> void;
+    auto imageGeneration() const -> uint4;
+    auto checkImage() -> void;
+    auto fillWindow (const Address& addr) -> bool;
+    auto fetchBytes (uint1* ptr, const Address& addr) -> void;
+    auto isStale (const ParserContext& pos) -> bool;
+    auto applyCommits (ParserContext& pos) -> void;
+public:
+    DecodeContext (const Translator& trans, LoadImage* ld, ContextDatabase* c_db);
+    DecodeContext (DecodeContext const& other) = delete;
+    ~DecodeContext();
+    auto allowContextSet (bool val) -> void;
+    auto trackContext (bool val) -> void;
+    auto isTrackingContext() const -> bool { return trackcontext; }
+    auto flushParsers() -> void;
+    auto getLoadImage() const -> LoadImage* { return loader; }
+    auto getContextCache() const -> const ContextRegionCache& { return *contexts; }
+    auto getStats() const -> const DecodeStats& { return stats; }
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class SerialImage
+ * @brief Serializes loadFill calls on a LoadImage shared by several decoding threads.
+ *
+ * Give each thread's DecodeContext a SerialImage over the shared image (all using the
+ * same mutex) when the image is not safe to read concurrently.
+ */
+class SerialImage : public LoadImage {
+private:
+    LoadImage* image;
+    std::mutex& lock;
+public:
+    SerialImage (LoadImage* img, std::mutex& mtx) : LoadImage (img->getFileName()), image (img), lock (mtx) {}
+    void loadFill (uint1* ptr, int4 size, const Address& addr) override
+    {
+        std::lock_guard<std::mutex> guard (lock);
+        image->loadFill (ptr, size, addr);
+    }
+    std::string getArchType (void) const override { return image->getArchType(); }
+    void adjustVma (long adjust) override { image->adjustVma (adjust); }
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class RegisterNames
+ * @brief (space, offset, size) to register name table of a translator.
+ *
+ * Filled with every register of the spec up front. Varnodes that are only part of a
+ * register (what Translate::getRegisterName resolves through its ordered map) are
+ * added the first time they are asked for, so every later lookup is a single hash
+ * probe that returns a reference and never allocates.
+ */
+class RegisterNames {
+private:
+    struct Key {
+        const AddrSpace* space;
+        uintb offset;
+        int4 size;
+        auto operator== (const Key& other) const -> bool
+        {
+            return space == other.space && offset == other.offset && size == other.size;
+        }
+    };
+    struct KeyHash {
+        auto operator() (const Key& key) const -> size_t
+        {
+            return std::hash<uintb>() (key.offset * 31 + key.size) ^ std::hash<const void*>() (key.space);
+        }
+    };
+    const Translate* trans;
+    std::unordered_map<Key, std::string, KeyHash> names;
+    mutable std::unordered_map<Key, std::string, KeyHash> derived; // guarded by 'lock'
+    mutable std::mutex lock;
+public:
+    RegisterNames (const Translate& t);
+    auto lookup (AddrSpace* space, uintb offset, int4 size) const -> const std::string&;
+};
+
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * @class Translator
+ * @brief Sleigh engine that can produce assembly and pcode from a single parse.
+ *
+ * The ghidra Sleigh class keeps its parser caches private, so the disassembly and pcode
+ * entry points each perform their own lookup of the instruction, and one Sleigh object
+ * can only be used by one thread. Translator moves that state into DecodeContext
+ * objects so that decode() can resolve an instruction once and feed both emitters from
+ * that single parse tree. The ghidra source itself is left untouched.
+ */
+class Translator : public Sleigh {
+    friend class DecodeContext;
+private:
+    LoadImage* loader;
+    ContextDatabase* context_db;
+    DecodeContext* maincontext = nullptr; // used by the Sleigh overrides
+    RegisterNames* regnames = nullptr;
+    DecisionTable* decisions = nullptr;
+    bool use_decisions = true;
+    int4 parser_cachesize = 2;
+    int4 parser_windowsize = 32;
+    int4 parsercache_size = 0;          // 0 when the ParserCache is off
+    int4 parsercache_windowsize = 0;
+    bool crossbuild = false;            // the spec has crossbuild directives
+    int4 bytewindow_size = 4096;        // 0 when instruction bytes are read one by one
+    int4 contextcache_size = 8;
+    std::unordered_set<const Constructor*> committing; // constructors with a globalset
+    mutable DecodeStats retired; // of destroyed DecodeContexts, guarded by 'statslock'
+    mutable std::mutex statslock;
+    // ----------------------------------------
+    auto resolve (DecodeContext& ctx, ParserContext& pos) const -> void;
+    auto resolveSymbol (TripleSymbol* sym, ParserWalker& walker, ParserContext& pos) const -> Constructor*;
+    auto getParser (DecodeContext& ctx, const Address& addr, int4 state, bool delayslot = false) const
+        -> ParserContext*;
+    auto emitAssembly (AssemblyEmit& emit, ParserContext* pos, const Address& addr) const -> void;
+    auto emitPcode (DecodeContext& ctx, PcodeEmit& emit, ParserContext* pos, const Address& addr) const -> int4;
+    auto checkAlignment (const Address& addr) const -> void;
+public:
+    Translator (LoadImage* ld, ContextDatabase* c_db);
+    Translator (Translator const& other) = delete;
+    virtual ~Translator();
+    // Sleigh overrides -----------------------
+    void reset (LoadImage* ld, ContextDatabase* c_db); // hides Sleigh::reset
+    void initialize (DocumentStorage& store) override;
+    void allowContextSet (bool val) const override;
+    int4 instructionLength (const Address& baseaddr) const override;
+    int4 oneInstruction (PcodeEmit& emit, const Address& baseaddr) const override;
+    int4 printAssembly (AssemblyEmit& emit, const Address& baseaddr) const override;
+    // ----------------------------------------
+    auto decode (AssemblyEmit& asm_emit, PcodeEmit& pcode_emit, const Address& baseaddr) const -> int4;
+    auto decode (DecodeContext& ctx, AssemblyEmit& asm_emit, PcodeEmit& pcode_emit,
+                 const Address& baseaddr) const -> int4;
+    auto instructionLength (DecodeContext& ctx, const Address& baseaddr) const -> int4;
+    auto oneInstruction (DecodeContext& ctx, PcodeEmit& emit, const Address& baseaddr) const -> int4;
+    auto getDecodeContext() const -> DecodeContext* { return maincontext; }
+    auto getRegisterNames() const -> const RegisterNames& { return *regnames; }
+    auto registerContextVariables (ContextDatabase* db) -> void;
+    auto useDecisionTable (bool val) -> void { use_decisions = val; }
+    auto hasContextCommits() const -> bool { return !committing.empty(); }
+    // parser caches --------------------------
+    auto setDisassemblyCacheSize (int4 cachesize, int4 windowsize) -> void;
+    auto getDisassemblyCacheSize() const -> int4 { return parser_cachesize; }
+    auto getDisassemblyWindowSize() const -> int4 { return parser_windowsize; }
+    auto setParserCacheSize (int4 size, int4 windowsize = 4096) -> void;
+    auto getParserCacheSize() const -> int4 { return parsercache_size; }
+    auto getParserWindowSize() const -> int4 { return parsercache_windowsize; }
+    auto setByteWindowSize (int4 size) -> void;
+    auto getByteWindowSize() const -> int4 { return bytewindow_size; }
+    auto setContextCacheSize (int4 size) -> void;
+    auto getContextCacheSize() const -> int4 { return contextcache_size; }
+    auto getStats() const -> DecodeStats;
+    auto resetStats() -> void;
+};
+
+}
+
+#endif /* CORO_TRANSLATOR_H */
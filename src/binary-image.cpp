@@ -19,33 +19,266 @@
  * coronium. If not, see <https://www.gnu.org/licenses/>.
   */
 
+#include <algorithm>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "coronium.hpp"
 #include "../include/coronium/binary-image.hpp"
 
 using namespace coronium;
 
+static const uintb COPY_PAGE = 4096;   // unit BinaryRaw::patch copies
+
 /* ================================================================================
  *
  * BinaryRaw
  *
  */
-BinaryRaw::BinaryRaw (uint1* buffer, int4 sz) : LoadImage ("nofile")
+BinaryRaw::BinaryRaw() : LoadImage ("nofile")
 
 {
     vma = 0;
-    binaryBuffer = buffer;
-    binsize = sz;
+}
+
+BinaryRaw::BinaryRaw (const uint1* buffer, uintb sz) : LoadImage ("nofile")
+
+{
+    vma = 0;
+    addRegion (0, buffer, sz);
 }
 
 BinaryRaw::~BinaryRaw ()
 
 {
+    for (auto& m : mappings)
+        munmap (m.first, m.second);
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+ * @brief Copy len bytes from off (relative to the region), patched pages first.
+ */
+auto
+BinaryRaw::Region::read (uint1* ptr, uintb off, uintb len) const -> void
+
+{
+    if (pages.empty()) {
+        memcpy (ptr, data + off, len);
+        return;
+    }
+    while (len != 0) {
+        uintb page = off / COPY_PAGE;
+        uintb n = std::min (len, (page + 1) * COPY_PAGE - off);
+        auto it = pages.find (page);
+        memcpy (ptr, (it == pages.end()) ? data + off : it->second.get() + off % COPY_PAGE, n);
+        ptr += n;
+        off += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief Overwrite len bytes at off (relative to the region), copying the pages first.
+ */
+auto
+BinaryRaw::Region::write (const uint1* bytes, uintb off, uintb len) -> void
+
+{
+    while (len != 0) {
+        uintb page = off / COPY_PAGE;
+        uintb start = page * COPY_PAGE;
+        uintb n = std::min (len, start + COPY_PAGE - off);
+        auto& copy = pages[page];
+        if (!copy) {
+            uintb pagelen = std::min (COPY_PAGE, size - start); // the last one may be short
+            copy.reset (new uint1[pagelen]);
+            memcpy (copy.get(), data + start, pagelen);
+        }
+        memcpy (copy.get() + (off - start), bytes, n);
+        bytes += n;
+        off += n;
+        len -= n;
+    }
+}
 
+/**
+ * @return The region containing offset, else the closest greater one, else nullptr.
+ */
+auto
+BinaryRaw::findRegion (uintb offset) const -> const Region*
+
+{
+    auto it = std::upper_bound (regions.begin(), regions.end(), offset,
+                                [] (uintb off, const Region& r) { return off < r.base; });
+    if (it != regions.begin() && offset - (it - 1)->base < (it - 1)->size)
+        return &*(it - 1);
+    return (it != regions.end()) ? &*it : nullptr;
 }
 
 // PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Add caller-owned memory to the image, it must outlive the image.
+ *
+ * @param[in] base First address of the region (relative to the base address).
+ * @param[in] data The bytes.
+ * @param[in] size Number of bytes.
+ */
+auto
+BinaryRaw::addRegion (uintb base, const uint1* data, uintb size) -> void
+
+{
+    if (size == 0)
+        return;
+    if (base + size - 1 < base)
+        throw LowlevelError ("Raw image region wraps around the address space");
+    Region r { base, size, data, {} };
+    auto it = std::upper_bound (regions.begin(), regions.end(), base,
+                                [] (uintb off, const Region& reg) { return off < reg.base; });
+    if ((it != regions.end() && it->base - base < size) ||
+        (it != regions.begin() && base - (it - 1)->base < (it - 1)->size))
+    {
+        ostringstream errmsg;
+        errmsg << "Raw image region at 0x" << hex << base << " overlaps another region";
+        throw LowlevelError (errmsg.str());
+    }
+    regions.insert (it, std::move (r));
+    ++generation;
+}
+
+/**
+ * @brief Map (part of) a file into the image without reading it.
+ *
+ * @param[in] base First address of the region (relative to the base address).
+ * @param[in] path File to map.
+ * @param[in] offset Offset in the file of the first byte.
+ * @param[in] size Number of bytes, by default up to the end of the file.
+ */
+auto
+BinaryRaw::mapFile (uintb base, const std::string& path, uintb offset, uintb size) -> void
+
+{
+    int fd = open (path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw LowlevelError ("Unable to open raw image file: " + path);
+    struct stat st;
+    if (fstat (fd, &st) != 0 || offset > (uintb)st.st_size) {
+        ::close (fd);
+        throw LowlevelError ("Unable to map raw image file: " + path);
+    }
+    size = std::min (size, (uintb)st.st_size - offset);
+    if (size == 0) {
+        ::close (fd);
+        return;
+    }
+    // mmap wants a page aligned file offset.
+    uintb pagemask = sysconf (_SC_PAGESIZE) - 1;
+    uintb skip = offset & pagemask;
+    size_t maplen = size + skip;
+    void* map = mmap (nullptr, maplen, PROT_READ, MAP_PRIVATE, fd, offset - skip);
+    ::close (fd);
+    if (map == MAP_FAILED)
+        throw LowlevelError ("Unable to map raw image file: " + path);
+    try {
+        addRegion (base, (const uint1*)map + skip, size);
+    } catch (LowlevelError&) {
+        munmap (map, maplen);
+        throw;
+    }
+    mappings.emplace_back (map, maplen);
+}
+
+// --------------------------------------------------------------------------------
+auto
+BinaryRaw::getSize() const -> uintb
+
+{
+    uintb total = 0;
+    for (auto& r : regions)
+        total += r.size;
+    return total;
+}
+
+/**
+ * @brief Number of bytes from addr to the end of the region holding it.
+ *
+ * @return 0 if addr is not in a region (loadFill at addr throws).
+ */
+auto
+BinaryRaw::getExtent (const Address& addr) const -> uintb
+
+{
+    uintb offset = addr.getOffset() - vma;
+    const Region* r = findRegion (offset);
+    if (r == nullptr || r->base > offset)
+        return 0;
+    return r->base + r->size - offset;
+}
+
+/**
+ * @brief Number of bytes from addr to the first region after it.
+ *
+ * @return 0 if addr is in a region, ~0 if no region follows it.
+ */
+auto
+BinaryRaw::getGap (const Address& addr) const -> uintb
+
+{
+    if ((addr.getOffset() < vma) && !regions.empty())
+        return regions.front().base + vma - addr.getOffset();
+    uintb offset = addr.getOffset() - vma;
+    const Region* r = findRegion (offset);
+    if (r == nullptr)
+        return ~(uintb)0;
+    return (r->base > offset) ? r->base - offset : 0;
+}
+
+/**
+ * @brief Overwrite size bytes of the image at addr and mark them dirty.
+ *
+ * Every byte must be inside a region. The 4 KB pages written to are copied the first
+ * time, so the caller's buffer (or the mapped file) is left untouched and a patch
+ * costs at most a page copy per page it touches, whatever the size of the region.
+ */
+auto
+BinaryRaw::patch (const Address& addr, const uint1* bytes, uintb size) -> void
+
+{
+    if (size == 0)
+        return;
+    uintb first = addr.getOffset() - vma;
+    auto it = std::upper_bound (regions.begin(), regions.end(), first,
+                                [] (uintb off, const Region& r) { return off < r.base; });
+    if (it == regions.begin() || first - (it - 1)->base >= (it - 1)->size)
+        throw LowlevelError ("Patch starts outside of the raw image");
+    --it;
+
+    // Check the whole patch is covered before changing anything.
+    uintb end = first + size;
+    auto last = it;
+    while (last->base + last->size < end) {
+        auto next = last + 1;
+        if (next == regions.end() || next->base != last->base + last->size)
+            throw LowlevelError ("Patch extends outside of the raw image");
+        last = next;
+    }
+
+    uintb pos = first;
+    for (; it != last + 1; ++it) {
+        uintb len = std::min (it->base + it->size, end) - pos;
+        it->write (bytes + (pos - first), pos - it->base, len);
+        pos += len;
+    }
+    dirty.insertRange (spaceid, addr.getOffset(), addr.getOffset() + size - 1);
+    ++generation;
+}
+
+// --------------------------------------------------------------------------------
 auto
 BinaryRaw::setBaseAddress(uintb baseaddr) -> void
 
@@ -60,41 +293,42 @@ BinaryRaw::adjustVma (long adjust) -> void
 {
     adjust = AddrSpace::addressToByte (adjust, spaceid->getWordSize());
     vma += adjust;
+    ++generation;
 }
 
-// --------------------------------------------------------------------------------
+/**
+ * @brief Copy bytes out of the regions.
+ *
+ * Gaps between regions and the bytes past the last one read as zero, as long as the
+ * first requested byte is in a region.
+ */
 auto
 BinaryRaw::loadFill (uint1* ptr, int4 len, const Address& addr) -> void
 
 {
     // Get the offset relative to the base address.
     uintb curaddr = addr.getOffset() - vma;
-    uintb readlen;
-    int4 rest = len;
-
-    if (curaddr >= binsize) {
-        // initial address not within binary.
-        goto ERROR;
-    }
-    // ensure that the amount read is within the addr space bounds of the binary.
-    readlen = (curaddr + len > binsize) ? binsize - curaddr : len;
-
-    memcpy (ptr, &binaryBuffer[curaddr], readlen);
-    curaddr += readlen;
-    rest -= readlen;
-
-    if (curaddr >= binsize) {
-        memset (ptr + len - rest, 0, rest);
-    }
-
-ERROR:
-    // wait to error out until we are unable to read any bytes.
-    if (len == rest) {
-        ostringstream errmsg;
-        errmsg << "Unable to load " << dec << len << " bytes at " << addr.getShortcut();
-        addr.printRaw (errmsg);
-        std::cout << errmsg.str() << std::endl;
-        exit (EXIT_FAILURE);
+    int4 offset = 0;
+
+    while (offset < len) {
+        const Region* r = findRegion (curaddr);
+        uintb rest = len - offset;
+        uintb readlen;
+        if (r == nullptr || r->base > curaddr) {
+            if (offset == 0) {  // initial address not within binary.
+                ostringstream errmsg;
+                errmsg << "Unable to load " << dec << len << " bytes at " << addr.getShortcut();
+                addr.printRaw (errmsg);
+                throw DataUnavailError (errmsg.str());
+            }
+            readlen = (r == nullptr) ? rest : std::min (r->base - curaddr, rest);
+            memset (ptr + offset, 0, readlen);
+        } else {
+            readlen = std::min (r->base + r->size - curaddr, rest);
+            r->read (ptr + offset, curaddr - r->base, readlen);
+        }
+        offset += readlen;
+        curaddr += readlen;
     }
 }
 
@@ -112,10 +346,11 @@ Range BinaryRaw::getAddressRange (uintb faddr, uintb laddr)
  */
 int4 Binary::bfdinit = 0;	// Global initialization variable
 
-Binary::Binary (const string& f, const string& t) : LoadImage (f)
+Binary::Binary (const string& f, const string& t, bool m) : LoadImage (f)
 
 {
   target = t;
+  usemap = m;
 
   if (bfdinit == 0) {
     bfdinit = 1;
@@ -139,6 +374,153 @@ Binary::~Binary ()
     delete [] buffer;
 }
 
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+ * @brief Build the sorted interval index of the sections.
+ *
+ * Sections may overlap (.tbss, and everything non-allocated sits at vma 0). Entries
+ * with the same vma are ordered so that the preferred one, allocated and with
+ * contents, comes last; findEntry() returns the containing entry that sorts last.
+ */
+auto
+Binary::indexSections() -> void
+
+{
+    sections.clear();
+    lasthit = 0;
+    for (asection* p = thebfd->sections; p != (asection*)NULL; p = p->next)
+    {
+        SectionMap sm;
+        sm.vma = p->vma;
+        sm.size = (p->size != 0) ? p->size : p->rawsize;
+        sm.sec = p;
+        sm.data = nullptr;
+        sections.push_back (sm);
+    }
+    auto rank = [] (const SectionMap& sm) {
+        return ((sm.sec->flags & SEC_ALLOC) ? 2 : 0) + ((sm.sec->flags & SEC_HAS_CONTENTS) ? 1 : 0);
+    };
+    std::stable_sort (sections.begin(), sections.end(), [&] (const SectionMap& a, const SectionMap& b) {
+        return (a.vma != b.vma) ? (a.vma < b.vma) : (rank (a) < rank (b));
+    });
+    uintb maxend = 0;
+    for (auto& sm : sections) {
+        maxend = std::max (maxend, sm.vma + sm.size);
+        sm.maxend = maxend;
+    }
+}
+
+/**
+ * @brief Map the file and record where the contents of each section live in it.
+ *
+ * Sections without contents (.bss) read as zeroes. Sections whose bytes are not
+ * stored verbatim in the file (compressed) keep data == nullptr and are still read
+ * through BFD. If the file cannot be mapped the buffered BFD path is used instead.
+ */
+auto
+Binary::mapFile() -> void
+
+{
+    int fd = ::open (filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size == 0) {
+        ::close (fd);
+        return;
+    }
+    void* map = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close (fd);
+    if (map == MAP_FAILED)
+        return;
+    mapbase = (uint1*)map;
+    mapsize = st.st_size;
+
+    for (auto& sm : sections) {
+        asection* p = sm.sec;
+        if ((p->flags & SEC_HAS_CONTENTS) && !bfd_is_section_compressed (thebfd, p) &&
+            (p->filepos >= 0) && ((uintb)p->filepos + sm.size <= mapsize))
+            sm.data = mapbase + p->filepos;
+    }
+}
+
+/**
+ * @brief Look offset up in the section index.
+ *
+ * Sequential reads mostly land in the section of the previous lookup, which is tried
+ * first. Otherwise a binary search finds the last entry starting at or below offset
+ * and the scan walks back only while some earlier entry could still reach offset.
+ *
+ * @return The section containing offset, else the closest greater one, else nullptr.
+ */
+auto
+Binary::findEntry (uintb offset) const -> const SectionMap*
+
+{
+    size_t n = sections.size();
+    size_t hint = lasthit.load (std::memory_order_relaxed);
+    if (hint < n) {
+        const SectionMap& sm = sections[hint];
+        if ((offset >= sm.vma) && (offset < sm.vma + sm.size) &&
+            (hint + 1 == n || sections[hint + 1].vma > offset))
+            return &sm;
+    }
+    auto it = std::upper_bound (sections.begin(), sections.end(), offset,
+                                [] (uintb off, const SectionMap& sm) { return off < sm.vma; });
+    size_t upper = it - sections.begin();
+    for (size_t i = upper; i-- > 0 && sections[i].maxend > offset;) {
+        if (offset < sections[i].vma + sections[i].size) {
+            lasthit.store (i, std::memory_order_relaxed);
+            return &sections[i];
+        }
+    }
+    // ... or closest greater section.
+    return (upper < n) ? &sections[upper] : nullptr;
+}
+
+/**
+ * @brief loadFill() for a mapped file, copies straight out of the mapping.
+ *
+ * Gaps between sections and the bytes past the last one read as zero, as long as the
+ * first requested byte is mapped.
+ */
+auto
+Binary::loadMapped (uint1* ptr, int4 size, const Address& addr) -> void
+
+{
+    uintb curaddr = addr.getOffset();
+    int4 offset = 0;
+
+    while (offset < size)
+    {
+        const SectionMap* sm = findEntry (curaddr);
+        uintb cursize = size - offset;
+        uintb readsize;
+        if (sm == nullptr || sm->vma > curaddr) {
+            if (offset == 0) {  // Initial address not mapped
+                ostringstream errmsg;
+                errmsg << "Unable to load " << dec << size << " bytes at " << addr.getShortcut();
+                addr.printRaw (errmsg);
+                throw DataUnavailError (errmsg.str());
+            }
+            readsize = (sm == nullptr) ? cursize : std::min (sm->vma - curaddr, cursize);
+            memset (ptr + offset, 0, readsize); // Fill in with zeroes to next section
+        } else {
+            readsize = std::min (sm->vma + sm->size - curaddr, cursize);
+            if (sm->data != nullptr)
+                memcpy (ptr + offset, sm->data + (curaddr - sm->vma), readsize);
+            else if (sm->sec->flags & SEC_HAS_CONTENTS) {
+                std::lock_guard<std::mutex> guard (bfdlock);
+                bfd_get_section_contents (thebfd, sm->sec, ptr + offset, (file_ptr) (curaddr - sm->vma), readsize);
+            } else
+                memset (ptr + offset, 0, readsize);
+        }
+        offset += readsize;
+        curaddr += readsize;
+    }
+}
+
 // PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 auto
 Binary::loadFill(uint1 *ptr,int4 size,const Address &addr) -> void
@@ -152,8 +534,12 @@ Binary::loadFill(uint1 *ptr,int4 size,const Address &addr) -> void
 
     if (addr.getSpace() != spaceid)
         throw DataUnavailError ("Trying to get loadimage bytes from space: " + addr.getSpace()->getName());
+    if (mapbase != nullptr) {
+        loadMapped (ptr, size, addr);
+        return;
+    }
     curaddr = addr.getOffset();
-    if ((curaddr >= bufoffset) && (curaddr + size < bufoffset + bufsize))  	// Requested bytes were previously buffered
+    if ((curaddr >= bufoffset) && (curaddr + size <= bufoffset + bufsize))  	// Requested bytes were previously buffered
     {
         uint1* bufptr = buffer + (curaddr - bufoffset);
         memcpy (ptr, bufptr, size);
@@ -201,6 +587,42 @@ Binary::loadFill(uint1 *ptr,int4 size,const Address &addr) -> void
     memcpy (ptr, buffer, size);	// Copy requested bytes from the buffer
 }
 
+/**
+ * @brief Number of bytes from addr to the end of the section holding it.
+ *
+ * Only known for a mapped file.
+ *
+ * @return 0 if addr is not in a section or the file is not mapped.
+ */
+auto
+Binary::getExtent (const Address& addr) const -> uintb
+
+{
+    if ((mapbase == nullptr) || (addr.getSpace() != spaceid))
+        return 0;
+    uintb offset = addr.getOffset();
+    const SectionMap* sm = findEntry (offset);
+    if (sm == nullptr || sm->vma > offset)
+        return 0;
+    return sm->vma + sm->size - offset;
+}
+
+/**
+ * @brief Number of bytes from addr to the first section after it.
+ *
+ * @return 0 if addr is in a section, ~0 if no section follows it.
+ */
+auto
+Binary::getGap (const Address& addr) const -> uintb
+
+{
+    uintb offset = addr.getOffset();
+    const SectionMap* sm = findEntry (offset);
+    if (sm == nullptr)
+        return ~(uintb)0;
+    return (sm->vma > offset) ? sm->vma - offset : 0;
+}
+
 // --------------------------------------------------------------------------------
 auto
 Binary::open(void) -> void
@@ -227,6 +649,10 @@ Binary::open(void) -> void
         std::string errmsg = "unrecognized binary format";
         throw LowlevelError (errmsg);
     }
+    indexSections();
+    if (usemap)
+        mapFile();
+    ++generation;
 }
 
 // --------------------------------------------------------------------------------
@@ -234,8 +660,15 @@ auto
 Binary::close(void) -> void
 
 {
+    if (mapbase != nullptr) {
+        munmap (mapbase, mapsize);
+        mapbase = nullptr;
+        mapsize = 0;
+    }
+    sections.clear();
     bfd_close (thebfd);
     thebfd = (bfd*)0;
+    ++generation;
 }
 
 // --------------------------------------------------------------------------------
@@ -264,6 +697,40 @@ Binary::adjustVma(long adjust) -> void
         s->vma += adjust;
         s->lma += adjust;
     }
+    // Every section moves by the same amount, so the index stays sorted.
+    for (auto& sm : sections) {
+        sm.vma += adjust;
+        sm.maxend += adjust;
+    }
+    ++generation;
+}
+
+/**
+ * @brief Overwrite size bytes of the image at addr and mark them dirty.
+ *
+ * The bytes must all be in one mapped section. The pages touched are made writable
+ * copy-on-write pages of the private mapping, the file does not change. Patches are
+ * lost if the Binary is closed and opened again.
+ */
+auto
+Binary::patch (const Address& addr, const uint1* bytes, uintb size) -> void
+
+{
+    if (size == 0)
+        return;
+    uintb first = addr.getOffset();
+    const SectionMap* sm = findEntry (first);
+    if (sm == nullptr || sm->vma > first || sm->data == nullptr || sm->vma + sm->size - first < size)
+        throw LowlevelError ("Patch is not within a single mapped section");
+
+    uint1* target = mapbase + (sm->data - mapbase) + (first - sm->vma);
+    uintb pagemask = sysconf (_SC_PAGESIZE) - 1;
+    uintptr_t page = (uintptr_t)target & ~(uintptr_t)pagemask;
+    if (mprotect ((void*)page, (uintptr_t)target + size - page, PROT_READ | PROT_WRITE) != 0)
+        throw LowlevelError ("Unable to make the mapping writable");
+    memcpy (target, bytes, size);
+    dirty.insertRange (spaceid, first, first + size - 1);
+    ++generation;
 }
 
 // --------------------------------------------------------------------------------
@@ -279,28 +746,10 @@ auto
 Binary::findSection(uintb offset,uintb &secsize) const -> asection *
 
 {
-    // Return section containing offset...
-    asection* p;
-    uintb start, stop;
-
-    for (p = thebfd->sections; p != (asection*)NULL; p = p->next)
-    {
-        start = p->vma;
-        secsize = (p->size != 0) ? p->size : p->rawsize;
-        stop = start + secsize;
-        if ((offset >= start) && (offset < stop))
-            return p;
-    }
-    // ... or closest greater section.
-    asection* result = (asection*)0;
-    for (p = thebfd->sections; p != (asection*)NULL; p = p->next)
-    {
-        if (p->vma > offset) {
-            if (result == (asection*)0)
-                result = p;
-            else if (p->vma < result->vma)
-                result = p;
-        }
-    }
-    return result;
+    // Return section containing offset or closest greater section.
+    const SectionMap* sm = findEntry (offset);
+    if (sm == nullptr)
+        return (asection*)0;
+    secsize = sm->size;
+    return sm->sec;
 }
@@ -0,0 +1,65 @@
+/**
+ * @file boundary-map.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/coronium/boundary-map.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * BoundaryMap
+ *
+ */
+auto
+BoundaryMap::isStart (const Address& addr) const -> bool
+
+{
+    if (addr.getSpace() != start.getSpace() || addr < start)
+        return false;
+    return isStart (addr.getOffset() - start.getOffset());
+}
+
+// --------------------------------------------------------------------------------
+auto
+BoundaryMap::count() const -> size_t
+
+{
+    size_t n = 0;
+    for (auto word : bits)
+        n += __builtin_popcountll (word);
+    return n;
+}
+
+/**
+ * @return The offset (from getStart()) of every instruction, in increasing order.
+ */
+auto
+BoundaryMap::offsets() const -> std::vector<uintb>
+
+{
+    std::vector<uintb> result;
+    result.reserve (count());
+    for (size_t i = 0; i != bits.size(); ++i) {
+        for (uint8 word = bits[i]; word != 0; word &= word - 1)
+            result.push_back (i * 64 + __builtin_ctzll (word));
+    }
+    return result;
+}
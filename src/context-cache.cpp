@@ -0,0 +1,113 @@
+/**
+ * @file context-cache.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "../include/coronium/context-cache.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * ContextRegionCache
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @param[in] db The ContextDatabase in front of which the cache sits.
+ * @param[in] size Number of regions kept (1 behaves like ContextCache).
+ */
+ContextRegionCache::ContextRegionCache (ContextDatabase* db, int4 size) : database (db)
+
+{
+    if (size < 1)
+        throw LowlevelError ("Bad size for context cache");
+    entries.assign (size, Entry { nullptr, 0, 0, nullptr, 0 });
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief The context blob in effect at addr (getContextSize() words).
+ *
+ * Valid until the next lookup that misses or the next invalidate().
+ */
+auto
+ContextRegionCache::lookup (const Address& addr) -> const uintm*
+
+{
+    AddrSpace* space = addr.getSpace();
+    uintb off = addr.getOffset();
+    Entry* e = &entries[mru];
+    if ((e->space != space) || (off < e->first) || (off > e->last)) {
+        Entry* victim = &entries[0];
+        e = nullptr;
+        for (auto& cand : entries) {
+            if ((cand.space == space) && (off >= cand.first) && (off <= cand.last)) {
+                e = &cand;
+                break;
+            }
+            if (cand.lastuse < victim->lastuse)
+                victim = &cand;
+        }
+        if (e == nullptr) {
+            stats.misses += 1;
+            if (victim->space != nullptr)
+                stats.evictions += 1;
+            victim->space = space;
+            victim->context = database->getContext (addr, victim->first, victim->last);
+            e = victim;
+        } else
+            stats.hits += 1;
+        mru = e - entries.data();
+    } else
+        stats.hits += 1;
+    e->lastuse = ++clock;
+    return e->context;
+}
+
+/**
+ * @brief Same as ContextCache::getContext.
+ */
+auto
+ContextRegionCache::getContext (const Address& addr, uintm* buf) -> void
+
+{
+    const uintm* context = lookup (addr);
+    for (int4 i = 0; i < database->getContextSize(); ++i)
+        buf[i] = context[i];
+}
+
+/**
+ * @brief Drop every region, the ContextDatabase changed.
+ */
+auto
+ContextRegionCache::invalidate() -> void
+
+{
+    for (auto& e : entries) {
+        e.space = nullptr;
+        e.lastuse = 0;
+    }
+    mru = 0;
+    stats.invalidations += 1;
+}
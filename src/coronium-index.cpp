@@ -0,0 +1,66 @@
+/**
+ * @file coronium-index.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Writes the language index of a cpu directory, and a pack of every .sla it
+ * references (run by the cpus target).
+ * usage: coronium-index <cpu-directory>
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+
+#include "../include/coronium/language-index.hpp"
+#include "../include/coronium/sla-pack.hpp"
+
+using namespace coronium;
+
+int main (int argc, char** argv)
+
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <cpu-directory>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    LanguageIndex index (argv[1]);
+
+    // Write the packs before the index, so the index is saved last. Several language ids share one .sla, pack each file once.
+    std::set<std::string> slafiles;
+    for (auto& lang : index.getLanguages()) {
+        auto sla = lang.second.ldefs.find ("slafile");
+        if (sla != lang.second.ldefs.end())
+            slafiles.insert (lang.second.cpu_dir + "/" + sla->second);
+    }
+    for (auto& sla : slafiles) {
+        try {
+            delete SlaPack::load (sla);
+        } catch (XmlError& err) {
+            std::cerr << "skipping " << sla << ": " << err.explain << std::endl;
+        }
+    }
+    if (!index.save()) {
+        std::cerr << "unable to write " << argv[1] << "/" << LanguageIndex::filename << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << index.getLanguages().size() << " languages indexed in " << argv[1] << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -19,9 +19,12 @@
  * coronium. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstring>
 #include <cstdio>  // perror(), fopen(), fputs() and fclose()
 #include <cstdlib> // EXIT_* macros
+#include <mutex>
+#include <thread>
 
 #include "coronium.hpp"
 
@@ -32,61 +35,6 @@ namespace coronium {
 char const* cpus_directory;
 }
 
-/*
- *
- * static functions
- *
- */
-static auto
-getFiles (std::string filetype, std::string dirname, std::vector<std::string>* files) -> void
-
-{
-    DIR* dir = opendir (dirname.c_str ());
-    struct dirent* dp;
-    std::string path;
-
-    if (!dir)
-        return;
-
-    while (dp = readdir (dir), dp != nullptr) {
-        auto entry = std::string (dp->d_name);
-
-        if (entry == "." || entry == "..")
-            continue;
-
-        path = (dirname + "/" + entry);
-
-        if (entry.rfind (filetype) != std::string::npos &&
-            entry.rfind (filetype) == (entry.length () - std::string (filetype).length ()))
-            files->push_back (path);
-
-        getFiles (filetype, path, files);
-    }
-    closedir (dir);
-}
-
-// --------------------------------------------------------------------------------
-static auto
-findFile (std::string fname, std::string dir) -> std::string
-
-{
-    std::vector<std::string> filelist;
-    auto ext = fname.find ("."); // get file extension.
-    getFiles (fname.substr (ext), dir, &filelist);
-    for (auto& i : filelist) {
-        std::string f = i.substr (i.find_last_of ("/\\") + 1);
-        // Need comparison to be case insensitive.
-        for (auto& c : fname)
-            c = std::tolower (c);
-        for (auto& c : f)
-            c = std::tolower (c);
-        if (f == fname) {
-            return std::string (i);
-        }
-    }
-    return "";
-}
-
 /*
  *
  * Coronium
@@ -110,20 +58,14 @@ Coronium::Coronium (std::string id)
         memcpy ((void*)cpus_directory, (void*)env, strlen (env) + 1);
     }
 
-    // find language definitions ("ldefs").
-    std::vector<std::string> filelist;
-    getFiles (".ldefs", cpus_directory, &filelist);
-    for (auto& f : filelist) {
-        DocumentStorage doc;
-        auto root = doc.openDocument (f)->getRoot ();
-        for (auto el : root->getChildren()) {
-            if (_lang_id == el->getAttributeValue ("id")) {
-                _cpu_dir = f.substr (0, f.find_last_of ("/\\"));
-                for (auto i = 0; i != el->getNumAttributes (); ++i) {
-                    ldefs[el->getAttributeName (i)] = el->getAttributeValue (i);
-                }
-            }
-        }
+    // find language definitions ("ldefs"), through the (cached) index of the cpu directory.
+    auto index = LanguageIndex::get (cpus_directory);
+    auto lang = index->find (_lang_id);
+    if (lang) {
+        _cpu_dir = lang->cpu_dir;
+        _pspec = lang->pspec;
+        for (auto& attr : lang->ldefs)
+            ldefs[attr.first] = attr.second;
     }
     OpBehavior::registerInstructions(pcode_behaviors, trans);
 }
@@ -137,6 +79,8 @@ Coronium::~Coronium()
         delete trans;
     if (loader)
         delete loader;
+    if (cache)
+        delete cache;
 
     for (auto &i : pcode_behaviors) {
         delete i;
@@ -162,77 +106,183 @@ Coronium::setCpuDirectory (std::string dir) -> void
     memcpy((void*)cpus_directory, (void*)dir.c_str(), dir.length() + 1);
 }
 
-// --------------------------------------------------------------------------------
+/**
+ * @brief Set the <context_set> defaults of the .pspec in cdb.
+ *
+ * The .pspec is parsed on the first call only, sessions reuse what was read.
+ */
 auto
 Coronium::importContexts (ContextDatabase* cdb) -> void
 
 {
-    DocumentStorage docs;
-    auto pspec = findFile (ldefs["processorspec"], _cpu_dir);
-    auto e = docs.openDocument (pspec)->getRoot();
-
-    std::unordered_map<std::string, std::string> ctx;
-    std::function<void (Element*&, std::unordered_map<std::string, std::string>&)> conf_ctx;
-    conf_ctx = [&conf_ctx] (Element*& el, std::unordered_map<std::string, std::string>& results) -> void {
-        if (!el)
-        {
-            return;
-        }
-        for (auto child : el->getChildren())
-        {
-            if ((el->getName() == "context_set") && (child->getName() == "set")) {
-                auto attr = child->getAttributeValue ("name");
-                auto val = child->getAttributeValue ("val");
-                results[attr] = val;
-            } else
-                conf_ctx (child, results);
-        }
-    };
+    if (!pspec_read) {
+        DocumentStorage docs;
+        auto e = docs.openDocument (_pspec)->getRoot();
+
+        std::unordered_map<std::string, std::string> ctx;
+        std::function<void (Element*&, std::unordered_map<std::string, std::string>&)> conf_ctx;
+        conf_ctx = [&conf_ctx] (Element*& el, std::unordered_map<std::string, std::string>& results) -> void {
+            if (!el)
+            {
+                return;
+            }
+            for (auto child : el->getChildren())
+            {
+                if ((el->getName() == "context_set") && (child->getName() == "set")) {
+                    auto attr = child->getAttributeValue ("name");
+                    auto val = child->getAttributeValue ("val");
+                    results[attr] = val;
+                } else
+                    conf_ctx (child, results);
+            }
+        };
 
-    conf_ctx (e, ctx);
-    for (auto p : ctx) {
+        conf_ctx (e, ctx);
+        pspec_context.assign (ctx.begin(), ctx.end());
+        pspec_read = true;
+    }
+    for (auto p : pspec_context) {
         try {
-            context->setVariableDefault (p.first, std::stoi (p.second));
+            cdb->setVariableDefault (p.first, std::stoi (p.second));
         } catch (LowlevelError& e) {
             std::cerr << "Warning: " << e.explain << std::endl;
         }
     }
 }
 
+/**
+ * @brief Feed the language's .sla to the translator.
+ *
+ * The spec is read from its binary pack when one is available (see SlaPack). The DOM
+ * is only needed while the translator restores itself from it, so it is released
+ * right after.
+ */
+auto
+Coronium::initializeTranslator() -> void
+
+{
+    std::string slafilepath = _cpu_dir + "/" + ldefs["slafile"];
+    std::unique_ptr<Document> doc (SlaPack::load (slafilepath));
+    DocumentStorage store;
+    store.registerTag (doc->getRoot());
+    trans->initialize (store);
+}
+
+/**
+ * @brief Decode the instruction at addr, through the cache when it is enabled.
+ *
+ * @param[in] addr Address of the instruction.
+ * @param[in] arena Receives the pcode of a freshly decoded instruction.
+ */
+auto
+Coronium::decodeAt (const Address& addr, const std::shared_ptr<PcodeArena>& arena) -> Instruction
+
+{
+    std::vector<uintm> ctx;
+    // A hit would skip the context commits of the instruction.
+    bool cached = cache && !trans->getDecodeContext()->isTrackingContext();
+    if (cached) {
+        // Copy the context now, decoding may commit new context values.
+        const uintm* words = context->getContext (addr);
+        ctx.assign (words, words + context->getContextSize());
+        const Instruction* hit = cache->lookup (addr, ctx, loader);
+        if (hit)
+            return *hit;
+    }
+    AssemblyRaw asm_emit;
+    PcodeRaw pcode_emit (this->pcode_behaviors, arena);
+    int4 length = trans->decode (asm_emit, pcode_emit, addr);
+    Instruction insn (std::move (asm_emit), std::move (pcode_emit), length);
+    if (cached)
+        cache->insert (addr, ctx, insn, loader);
+    return insn;
+}
+
+/**
+ * @brief Whether several threads may call loadFill on the loader at once.
+ *
+ * A Binary that is not mapped keeps a mutable read buffer, anything else only reads
+ * memory. Threads must go through a SerialImage when this is false.
+ */
+auto
+Coronium::isLoaderShareable() const -> bool
+
+{
+    auto* binary = dynamic_cast<Binary*> (loader);
+    return (dynamic_cast<BinaryRaw*> (loader) != nullptr) || (binary && binary->isMapped());
+}
+
 // PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 auto
 Coronium::load (const std::string& f) -> void
 
 {
-    std::string slafilepath = _cpu_dir + "/" + ldefs["slafile"];
-    Element* sleighroot = docstorage.openDocument (slafilepath)->getRoot();
-    docstorage.registerTag (sleighroot);
     loader = new Binary (f, "default");
     context = new ContextInternal();      // Create a processor context
-    trans = new Sleigh (loader, context); // Instantiate the translator
+    trans = new Translator (loader, context); // Instantiate the translator
 
-    trans->initialize (docstorage);
+    initializeTranslator();
     dynamic_cast<Binary*> (loader)->attachToSpace (trans->getDefaultCodeSpace());
     importContexts (context);
 }
 
 // --------------------------------------------------------------------------------
 auto
-Coronium::load (uint1* imgbuffer, int4 imgsize) -> void
+Coronium::load (const uint1* imgbuffer, uintb imgsize) -> void
 
 {
-    std::string slafilepath = _cpu_dir + "/" + ldefs["slafile"];
-    Element* sleighroot = docstorage.openDocument (slafilepath)->getRoot();
-    docstorage.registerTag (sleighroot);
     context = new ContextInternal();
     loader = new BinaryRaw (imgbuffer, imgsize);
-    trans = new Sleigh (loader, context);
+    trans = new Translator (loader, context);
 
-    trans->initialize (docstorage);
+    initializeTranslator();
     dynamic_cast<BinaryRaw*> (loader)->attachToSpace (trans->getDefaultCodeSpace());
     importContexts (context);
 }
 
+/**
+ * @brief Load a file as a raw image (mapped, not read), e.g. a memory dump.
+ *
+ * The file becomes a single region at address 0. More regions can be added through
+ * getBinaryRawImage().
+ */
+auto
+Coronium::loadRaw (const std::string& f) -> void
+
+{
+    std::unique_ptr<BinaryRaw> raw (new BinaryRaw());
+    raw->mapFile (0, f);
+    context = new ContextInternal();
+    loader = raw.release(); // owned by this from here on, also if initializeTranslator throws
+    trans = new Translator (loader, context);
+
+    initializeTranslator();
+    static_cast<BinaryRaw*> (loader)->attachToSpace (trans->getDefaultCodeSpace());
+    importContexts (context);
+}
+
+/**
+ * @brief Load the language only, for use by Sessions.
+ *
+ * Does nothing if a language was already loaded (by any of the load functions). The
+ * image of this Coronium itself is then empty: every read throws DataUnavailError.
+ */
+auto
+Coronium::loadLanguage() -> void
+
+{
+    if (trans)
+        return;
+    auto* raw = new BinaryRaw();
+    context = new ContextInternal();
+    loader = raw;
+    trans = new Translator (loader, context);
+
+    initializeTranslator();
+    raw->attachToSpace (trans->getDefaultCodeSpace());
+    importContexts (context);
+}
+
 // --------------------------------------------------------------------------------
 auto
 Coronium::getBinaryImage() const -> Binary*
@@ -264,8 +314,8 @@ Coronium::getBinaryRawImage() const -> BinaryRaw*
  *
  *
  * This method relies upon AssemblyRaw::dump and PcodeRaw::dump. Those two
- * methods perform the actual decoding and hold the storage of assembly and
- * pcode data. This method combines the side effects of both those methods.
+ * methods hold the storage of assembly and pcode data. Both are filled from a
+ * single parse of each instruction through Translator::decode.
  *
  * @param[in] addr Start address.
  * @param[in] ninsns Number of instructions to decode.
@@ -276,14 +326,12 @@ Coronium::disassemble (Address addr, uint4 ninsns) -> std::vector<Instruction>
 
 {
     std::vector<Instruction> result;
+    auto arena = std::make_shared<PcodeArena>(); // pcode storage shared by the whole batch
 
+    result.reserve (ninsns);
     while (result.size() != ninsns) {
-        AssemblyRaw asm_emit;
-        PcodeRaw pcode_emit (this->pcode_behaviors);
-        trans->printAssembly (asm_emit, addr);
-        int4 length = trans->oneInstruction (pcode_emit, addr);
-        result.push_back (std::move (Instruction (asm_emit, std::move(pcode_emit), length)));
-        addr = addr + length;
+        result.push_back (decodeAt (addr, arena));
+        addr = addr + result.back().size;
     }
     return result;
 }
@@ -294,17 +342,432 @@ Coronium::dump (Range rng) -> std::vector<Instruction>
 
 {
     std::vector<Instruction> result;
+    auto arena = std::make_shared<PcodeArena>(); // pcode storage shared by the whole batch
 
     Address pos = rng.getFirstAddr ();
     Address finish = rng.getLastAddr ();
     while (pos < finish) {
-        AssemblyRaw asm_emit;
-        PcodeRaw pcode_emit (this->pcode_behaviors);
-        trans->printAssembly (asm_emit, pos);
-        int4 length = trans->oneInstruction (pcode_emit, pos);
-        result.push_back (std::move (Instruction (asm_emit, std::move(pcode_emit), length)));
-        pos = pos + length;
+        result.push_back (decodeAt (pos, arena));
+        pos = pos + result.back().size;
     }
     return result;
 }
+
+/**
+ * @brief Streaming counterpart of dump(Range).
+ *
+ * Every instruction in the range is decoded into the same Instruction object, whose
+ * assembly strings and pcode arena are reused, and handed to visit. Memory use does
+ * not depend on the size of the range. The Instruction (and copies of it, which share
+ * its pcode arena) is only valid until visit returns.
+ *
+ * @param[in] rng Range of addresses to decode.
+ * @param[in] visit Called once per instruction. Return false to stop early.
+ * @return Address following the last decoded instruction.
+ */
+auto
+Coronium::dump (Range rng, std::function<bool (Instruction const&)> visit) -> Address
+
+{
+    auto arena = std::make_shared<PcodeArena>();
+    Instruction insn (AssemblyRaw(), PcodeRaw (this->pcode_behaviors, arena), 0);
+
+    Address pos = rng.getFirstAddr ();
+    Address finish = rng.getLastAddr ();
+    while (pos < finish) {
+        arena->clear();
+        insn.pcode.clear();
+        insn.size = trans->decode (insn.assembly, insn.pcode, pos);
+        pos = pos + insn.size;
+        if (!visit (insn))
+            break;
+    }
+    return pos;
+}
+
+/**
+ * @brief Multi-threaded variant of dump(Range).
+ *
+ * The range is cut into one chunk per thread. Every worker decodes its chunk with its
+ * own DecodeContext over the shared (read-only) Translator, starting speculatively at
+ * the first byte of the chunk. The chunks are then stitched together in order: a
+ * speculative instruction is kept only if it starts exactly where the previous one
+ * ended. Otherwise that instruction is decoded again on the calling thread until the
+ * stream resynchronizes with the worker's output. Workers cannot commit context
+ * changes to the ContextDatabase (globalset), so for specs with context commits
+ * (Translator::hasContextCommits()) and with trackContext() on, this is dump(Range).
+ *
+ * @param[in] rng Range of addresses to decode.
+ * @param[in] nthreads Number of worker threads (0 means one per hardware thread).
+ * @return A vector of Instructions identical to what dump(Range) returns.
+ */
+auto
+Coronium::dumpParallel (Range rng, uint4 nthreads) -> std::vector<Instruction>
+
+{
+    const uintb min_chunk = 0x1000; // Not worth a thread below this many bytes.
+
+    if (nthreads == 0)
+        nthreads = std::max (1u, std::thread::hardware_concurrency());
+    uintb span = (rng.getLast() > rng.getFirst()) ? rng.getLast() - rng.getFirst() : 0;
+    if (span / nthreads < min_chunk)
+        nthreads = std::max ((uintb)1, span / min_chunk);
+    if (nthreads == 1 || trans->hasContextCommits() || trans->getDecodeContext()->isTrackingContext())
+        return dump (rng);
+
+    struct Chunk {
+        Address start, finish;
+        std::vector<Instruction> insns;
+    };
+    std::vector<Chunk> chunks (nthreads);
+    uintb step = span / nthreads;
+    for (uint4 i = 0; i != nthreads; ++i) {
+        chunks[i].start = rng.getFirstAddr() + i * step;
+        chunks[i].finish = (i + 1 == nthreads) ? rng.getLastAddr() : rng.getFirstAddr() + (i + 1) * step;
+    }
+
+    std::mutex loadlock;
+    bool shared_loader = isLoaderShareable();
+    auto worker = [&] (Chunk& chunk) {
+        SerialImage serial (loader, loadlock);
+        DecodeContext ctx (*trans, shared_loader ? loader : &serial, context);
+        ctx.allowContextSet (false);
+        auto arena = std::make_shared<PcodeArena>();
+        Address pos = chunk.start;
+        try {
+            while (pos < chunk.finish) {
+                AssemblyRaw asm_emit;
+                PcodeRaw pcode_emit (this->pcode_behaviors, arena);
+                int4 length = trans->decode (ctx, asm_emit, pcode_emit, pos);
+                chunk.insns.emplace_back (std::move (asm_emit), std::move (pcode_emit), length);
+                pos = pos + length;
+            }
+        } catch (...) {
+            // Most likely a speculative start in the middle of an instruction. Whatever is
+            // left of the chunk gets decoded (and any real error raised) while stitching.
+        }
+    };
+    std::vector<std::thread> threads;
+    for (auto& chunk : chunks)
+        threads.emplace_back (worker, std::ref (chunk));
+    for (auto& t : threads)
+        t.join();
+
+    // Stitch the chunks together in order.
+    std::vector<Instruction> result;
+    auto arena = std::make_shared<PcodeArena>();
+    Address pos = rng.getFirstAddr ();
+    for (auto& chunk : chunks) {
+        size_t k = 0;
+        while (pos < chunk.finish) {
+            while (k < chunk.insns.size() && chunk.insns[k].assembly.address < pos)
+                ++k;
+            if (k < chunk.insns.size() && chunk.insns[k].assembly.address == pos) {
+                pos = pos + chunk.insns[k].size;
+                result.push_back (std::move (chunk.insns[k++]));
+                continue;
+            }
+            AssemblyRaw asm_emit;
+            PcodeRaw pcode_emit (this->pcode_behaviors, arena);
+            int4 length = trans->decode (asm_emit, pcode_emit, pos);
+            result.emplace_back (std::move (asm_emit), std::move (pcode_emit), length);
+            pos = pos + length;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Column-oriented counterpart of dump(Range).
+ *
+ * Decodes the same instructions as dump(Range) into a single InstructionBatch.
+ * Mnemonic ids are shared by every batch of this Coronium (see getMnemonics()).
+ */
+auto
+Coronium::dumpBatch (Range rng) -> InstructionBatch
+
+{
+    InstructionBatch batch (mnemonics);
+    DecodeContext& ctx = *trans->getDecodeContext();
+
+    Address pos = rng.getFirstAddr ();
+    Address finish = rng.getLastAddr ();
+    while (pos < finish)
+        pos = pos + batch.append (*trans, ctx, pos);
+    return batch;
+}
+
+/**
+ * @brief Write the instructions of dump(Range) to path in the binary pcode format.
+ *
+ * Instructions are streamed to the file as they are decoded, read it back with a
+ * PcodeReader.
+ *
+ * @return Address following the last decoded instruction.
+ */
+auto
+Coronium::exportPcode (Range rng, const std::string& path) -> Address
+
+{
+    PcodeWriter writer (path);
+    Address end = dump (rng, [&writer] (Instruction const& insn) {
+        writer.write (insn);
+        return true;
+    });
+    writer.close();
+    return end;
+}
+
+/**
+ * @brief Find where the instructions of a linear sweep over rng start.
+ *
+ * Only instruction lengths are computed: the constructors are matched but no operand
+ * is printed and no pcode is built. Bytes that do not decode are skipped one
+ * alignment unit at a time and left unmarked, as are unaligned addresses (up to the
+ * next aligned one, also after a jump over a gap) and addresses outside the image (up
+ * to the next region or section of a BinaryRaw or Binary). Covers the same addresses
+ * as dump(Range).
+ *
+ * @param[in] rng Range to sweep.
+ * @return One bit per byte of rng, set on every instruction start.
+ */
+auto
+Coronium::sweepLengths (Range rng) -> BoundaryMap
+
+{
+    Address first = rng.getFirstAddr ();
+    BoundaryMap map (first, rng.getLast() - rng.getFirst());
+    int4 align = trans->getAlignment();
+    auto* raw = dynamic_cast<BinaryRaw*> (loader);
+    auto* binary = dynamic_cast<Binary*> (loader);
+
+    uintb off = 0;
+    while (off < map.getSize()) {
+        // instructionLength() does not check the alignment, decode() would throw here.
+        uintb misalign = (first.getOffset() + off) % align;
+        if (misalign != 0) {
+            off += align - misalign;
+            continue;
+        }
+        try {
+            int4 length = trans->instructionLength (first + off);
+            map.mark (off);
+            off += length;
+        } catch (BadDataError& err) {
+            off += align;
+        } catch (UnimplError& err) {
+            off += align;
+        } catch (DataUnavailError& err) {
+            Address addr = first + off;
+            uintb gap = raw ? raw->getGap (addr) : (binary ? binary->getGap (addr) : 0);
+            if (gap >= map.getSize() - off)
+                break;
+            off += std::max (gap, (uintb)align);
+        }
+    }
+    return map;
+}
+
+/**
+ * @brief Cache decoded instructions across disassemble() and dump(Range) calls.
+ *
+ * Entries are keyed by address and context, and are checked against the image bytes
+ * on every hit. Calling it again only changes the budget.
+ *
+ * @param[in] budget Approximate memory (in bytes) the cache may hold.
+ */
+auto
+Coronium::enableCache (size_t budget) -> void
+
+{
+    if (cache)
+        cache->setBudget (budget);
+    else
+        cache = new DecodeCache (budget);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Coronium::disableCache() -> void
+
+{
+    delete cache;
+    cache = nullptr;
+}
+
+/**
+ * @brief Forget cached instructions overlapping rng (e.g. after patching the image).
+ *
+ * Also drops the translator's cached parses, they are not indexed by range.
+ */
+auto
+Coronium::invalidate (Range rng) -> void
+
+{
+    if (cache)
+        cache->invalidate (rng);
+    if (trans)
+        trans->getDecodeContext()->flushParsers();
+}
+
+/**
+ * @brief Set the context variable var to value over rng, e.g. TMode for Thumb code.
+ *
+ * The range becomes an explicit change point of var: a commit flowing from an
+ * instruction before it stops at its first address, as in Ghidra. Instructions inside
+ * the range may still commit other values. Cached decodings of the range are dropped.
+ *
+ * @param[in] rng Addresses to override (inclusive).
+ * @param[in] var Name of a context variable of the spec.
+ * @param[in] value Unshifted value of the variable.
+ */
+auto
+Coronium::setContext (Range rng, const std::string& var, uintm value) -> void
+
+{
+    Address end;                // invalid: up to the end of the space
+    if (rng.getLast() < rng.getSpace()->getHighest())
+        end = rng.getLastAddr() + 1;
+    context->setVariableRegion (var, rng.getFirstAddr(), end, value);
+    invalidate (rng);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Coronium::getContextValue (const std::string& var, const Address& addr) const -> uintm
+
+{
+    return context->getVariable (var, addr);
+}
+
+/**
+ * @brief Decode with the context committed so far (e.g. ARM/Thumb interworking).
+ *
+ * Instructions always commit their context changes (globalset) to the ContextDatabase
+ * while decoding pcode, as long as context setting is allowed (the default, see
+ * Translator::allowContextSet). A parse cached by the translator however was resolved
+ * under the context of its address at that time. With tracking on, such a parse is
+ * resolved again when the context of its address has changed since, the decode cache
+ * is bypassed (its hits do not commit) and dumpParallel() falls back to dump(Range).
+ * Mixed-mode code then decodes in one pass of dump(Range), each instruction in the
+ * mode committed by the instructions before it. sweepLengths() does not build pcode
+ * and so never commits.
+ */
+auto
+Coronium::trackContext (bool val) -> void
+
+{
+    trans->getDecodeContext()->trackContext (val);
+}
+
+/**
+ * @brief Overwrite size bytes of the image at addr.
+ *
+ * The loader records the bytes as dirty (see BinaryRaw::getDirty() and
+ * Binary::getDirty()) and every cached decoding of them is dropped. Only a BinaryRaw
+ * or a mapped Binary can be patched.
+ */
+auto
+Coronium::patch (const Address& addr, const uint1* bytes, uintb size) -> void
+
+{
+    if (size == 0)
+        return;
+    if (auto* raw = dynamic_cast<BinaryRaw*> (loader))
+        raw->patch (addr, bytes, size);
+    else if (auto* binary = dynamic_cast<Binary*> (loader))
+        binary->patch (addr, bytes, size);
+    else
+        throw LowlevelError ("Image cannot be patched");
+    invalidate (Range (addr.getSpace(), addr.getOffset(), addr.getOffset() + size - 1));
+}
+
+/**
+ * @brief Bring the result of dump(Range) up to date with patched bytes.
+ *
+ * For each dirty range, decoding restarts at the first instruction overlapping it and
+ * stops once past the range at an address where an old instruction started (the
+ * streams have resynchronized) or at the end of the dump. Only the instructions in
+ * between are replaced. If decoding fails, that range is left as it was and the error
+ * is thrown. Cached decodings of the dirty ranges are dropped first, so the bytes may
+ * also have been patched on the loader itself.
+ *
+ * @param[in,out] insns Instructions of a dump, in address order.
+ * @param[in] dirty Patched addresses, e.g. BinaryRaw::getDirty().
+ * @return Number of instructions decoded.
+ */
+auto
+Coronium::redump (std::vector<Instruction>& insns, const RangeList& dirty) -> size_t
+
+{
+    if (insns.empty())
+        return 0;
+    // The bytes may have been patched on the loader rather than through patch().
+    if (cache)
+        for (auto& rng : dirty)
+            cache->invalidate (rng);
+    trans->getDecodeContext()->flushParsers();
+
+    auto arena = std::make_shared<PcodeArena>();
+    Address stop = insns.back().assembly.address + insns.back().size;
+    size_t ndecoded = 0;
+
+    for (auto& rng : dirty) {
+        Address dfirst = rng.getFirstAddr();
+        Address dlast = rng.getLastAddr();
+        // First instruction that ends past the start of the dirty bytes.
+        auto first = std::partition_point (insns.begin(), insns.end(), [&] (const Instruction& i) {
+            return !(dfirst < i.assembly.address + i.size);
+        });
+        if (first == insns.end() || dlast < first->assembly.address)
+            continue;           // not covered by the dump
+
+        std::vector<Instruction> fresh;
+        Address pos = first->assembly.address;
+        auto old = first;
+        while (pos < stop) {
+            if (dlast < pos) {
+                while (old != insns.end() && old->assembly.address < pos)
+                    ++old;
+                if (old != insns.end() && old->assembly.address == pos)
+                    break;      // resynchronized
+            }
+            fresh.push_back (decodeAt (pos, arena));
+            pos = pos + fresh.back().size;
+        }
+        while (old != insns.end() && old->assembly.address < pos)
+            ++old;
+
+        ndecoded += fresh.size();
+        size_t at = first - insns.begin();
+        insns.erase (first, old);
+        insns.insert (insns.begin() + at, std::make_move_iterator (fresh.begin()),
+                      std::make_move_iterator (fresh.end()));
+    }
+    return ndecoded;
+}
+
+/**
+ * @brief Snapshot of the decode pipeline counters since load() or resetStats().
+ *
+ * Includes the threads of dumpParallel and FlowGraph once they have finished. All
+ * zero unless the library was built with -DCORONIUM_STATS=ON (see
+ * DecodeStats::isEnabled()).
+ */
+auto
+Coronium::getStats() const -> DecodeStats
+
+{
+    return trans ? trans->getStats() : DecodeStats();
+}
+
+// --------------------------------------------------------------------------------
+auto
+Coronium::resetStats() -> void
+
+{
+    if (trans)
+        trans->resetStats();
+}
+
 // |EOF|--------------------------------------------------------------------------|
@@ -0,0 +1,357 @@
+/**
+ * @file decision-table.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/coronium/decision-table.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#if defined(__SSE2__) && !defined(CORO_SCALAR)
+#define CORO_SIMD
+#include <immintrin.h>
+#endif
+/* local (ghidra) */
+#include "translate.hh"
+
+using namespace coronium;
+
+static const uint4 bufsize = 16; // bytes of instruction held by a ParserContext
+static const uint4 minlanes = 4; // smallest leaf worth unpacking into lanes
+static const uint4 lanechunk = 8; // lanes tested before looking for a match
+
+/*
+ *
+ * static functions
+ *
+ */
+
+/**
+ * @brief Same parsing as the restoreXml methods (decimal, 0x hex or 0 octal).
+ */
+static auto
+readInt (const Element* el, const std::string& attr) -> intb
+
+{
+    return std::stoll (el->getAttributeValue (attr), nullptr, 0);
+}
+
+/**
+ * @brief Bit i is set if lane i of mask and of value match the 16 bytes of window (n <= 64).
+ */
+static auto
+matchLanes (const uint1* window, const uint1* mask, const uint1* value, uint4 n) -> uint8
+
+{
+    uint8 bits = 0;
+    uint4 i = 0;
+#if defined(CORO_SIMD)
+    __m128i win = _mm_loadu_si128 ((const __m128i*)window);
+#if defined(__AVX2__)
+    __m256i win2 = _mm256_broadcastsi128_si256 (win);
+    for (; i + 2 <= n; i += 2) {
+        __m256i m = _mm256_loadu_si256 ((const __m256i*)(mask + 16 * i));
+        __m256i v = _mm256_loadu_si256 ((const __m256i*)(value + 16 * i));
+        uint4 eq = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_and_si256 (win2, m), v));
+        bits |= (uint8)((eq & 0xffff) == 0xffff) << i;
+        bits |= (uint8)((eq >> 16) == 0xffff) << (i + 1);
+    }
+#endif
+    for (; i != n; ++i) {
+        __m128i m = _mm_load_si128 ((const __m128i*)(mask + 16 * i));
+        __m128i v = _mm_load_si128 ((const __m128i*)(value + 16 * i));
+        int eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_and_si128 (win, m), v));
+        bits |= (uint8)(eq == 0xffff) << i;
+    }
+#else
+    uint8 w[2], m[2], v[2];
+    memcpy (w, window, 16);
+    for (; i != n; ++i) {
+        memcpy (m, mask + 16 * i, 16);
+        memcpy (v, value + 16 * i, 16);
+        bits |= (uint8)(((w[0] & m[0]) == v[0]) && ((w[1] & m[1]) == v[1])) << i;
+    }
+#endif
+    return bits;
+}
+
+/*
+ *
+ * DecisionTable
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+/**
+ * @param[in] sleigh The <sleigh> element the translator was restored from.
+ * @param[in] symtab Symbol table of that translator.
+ */
+DecisionTable::DecisionTable (const Element* sleigh, const SymbolTable& symtab)
+
+{
+    for (auto* table : sleigh->getChildren()) {
+        if (table->getName() != "symbol_table")
+            continue;
+        for (auto* el : table->getChildren()) {
+            if (el->getName() != "subtable_sym")
+                continue;
+            uintm id = readInt (el, "id");
+            auto* sub = dynamic_cast<SubtableSymbol*> (symtab.findSymbol (id));
+            if (sub == nullptr)
+                continue;
+            for (auto* child : el->getChildren()) {
+                if (child->getName() != "decision")
+                    continue;
+                if (roots.size() <= id)
+                    roots.resize (id + 1, -1);
+                roots[id] = nodes.size();
+                nodes.emplace_back();
+                lower (child, sub, roots[id]);
+            }
+        }
+    }
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+ * @brief Fill nodes[at] from a <decision> element, children are appended.
+ */
+auto
+DecisionTable::lower (const Element* el, SubtableSymbol* sub, uint4 at) -> void
+
+{
+    Node node {};
+    int4 startbit = readInt (el, "start");
+    int4 size = readInt (el, "size");
+
+    if (size == 0) {
+        node.kind = LEAF;
+        node.first = candidates.size();
+        for (auto* pair : el->getChildren()) {
+            if (pair->getName() != "pair")
+                continue;
+            Candidate cand { sub->getConstructor (readInt (pair, "id")), Block(), Block() };
+            const Element* pat = pair->getChildren().front();
+            if (pat->getName() == "instruct_pat")
+                cand.instr = readBlock (pat->getChildren().front());
+            else if (pat->getName() == "context_pat")
+                cand.context = readBlock (pat->getChildren().front());
+            else {              // combine_pat: <context_pat> then <instruct_pat>
+                cand.context = readBlock (pat->getChildren()[0]->getChildren().front());
+                cand.instr = readBlock (pat->getChildren()[1]->getChildren().front());
+            }
+            candidates.push_back (cand);
+        }
+        node.count = candidates.size() - node.first;
+        unpackLeaf (node);
+        nodes[at] = node;
+        return;
+    }
+
+    node.kind = xml_readbool (el->getAttributeValue ("context")) ? CONTEXT : INSTRUCTION;
+    node.size = size;
+    node.startbit = startbit;
+    if (node.kind == INSTRUCTION) {
+        // The arithmetic of ParserContext::getInstructionBits, done once.
+        int4 bitoff = startbit % 8;
+        int4 nbytes = (bitoff + size - 1) / 8 + 1;
+        if (nbytes <= (int4)sizeof (uintm) && startbit / 8 < (int4)bufsize) {
+            node.byte = startbit / 8;
+            node.nbytes = nbytes;
+            node.lshift = 8 * (sizeof (uintm) - nbytes) + bitoff;
+            node.rshift = 8 * sizeof (uintm) - size;
+        }
+    }
+    std::vector<const Element*> children;
+    for (auto* child : el->getChildren())
+        if (child->getName() == "decision")
+            children.push_back (child);
+    node.first = nodes.size();
+    nodes.resize (nodes.size() + children.size());
+    nodes[at] = node;
+    for (size_t i = 0; i != children.size(); ++i)
+        lower (children[i], sub, node.first + i);
+}
+
+/**
+ * @brief Copy a <pat_block> (already normalized when the .sla was written).
+ */
+auto
+DecisionTable::readBlock (const Element* el) -> Block
+
+{
+    Block blk;
+    blk.offset = readInt (el, "offset");
+    blk.nonzero = readInt (el, "nonzero");
+    if (blk.nonzero <= 0) {
+        blk.offset = 0;
+        return blk;
+    }
+    blk.word = words.size();
+    for (auto* word : el->getChildren()) {
+        words.push_back (readInt (word, "mask"));
+        words.push_back (readInt (word, "val"));
+    }
+    blk.nwords = (words.size() - blk.word) / 2;
+    return blk;
+}
+
+/**
+ * @brief Spread the instruction patterns of a leaf's candidates over 16 byte lanes.
+ *
+ * Byte k of a lane holds the mask (or value) bits of instruction byte k after the
+ * start of the operand, as read big endian from the mask/value words. Leaves that are
+ * small, or whose patterns reach past 16 bytes, are left to isMatch().
+ */
+auto
+DecisionTable::unpackLeaf (Node& leaf) -> void
+
+{
+    lanemask.resize (candidates.size(), Lane());
+    lanevalue.resize (candidates.size(), Lane());
+    if (leaf.count < minlanes)
+        return;
+    uint4 span = 0;
+    for (uint4 i = leaf.first; i != leaf.first + leaf.count; ++i) {
+        const Block& blk = candidates[i].instr;
+        if (blk.nonzero < 0)
+            return;
+        if (blk.nonzero > 0)
+            span = std::max (span, (uint4)(blk.offset + blk.nwords * sizeof (uintm)));
+    }
+    if (span > bufsize)
+        return;
+    for (uint4 i = leaf.first; i != leaf.first + leaf.count; ++i) {
+        const Block& blk = candidates[i].instr;
+        for (uint4 w = 0; w != blk.nwords; ++w) {
+            for (uint4 k = 0; k != sizeof (uintm); ++k) {
+                uint4 shift = 8 * (sizeof (uintm) - 1 - k);
+                uint4 byte = blk.offset + w * sizeof (uintm) + k;
+                lanemask[i].bytes[byte] = words[blk.word + 2 * w] >> shift;
+                lanevalue[i].bytes[byte] = words[blk.word + 2 * w + 1] >> shift;
+            }
+        }
+    }
+    leaf.nbytes = std::max (span, (uint4)1);
+}
+
+/**
+ * @brief First candidate of a leaf that matches, the way DecisionNode::resolve tries them.
+ */
+auto
+DecisionTable::matchLeaf (const Node& leaf, ParserWalker& walker, const uint1* buf, uint4 base) const
+    -> Constructor*
+
+{
+    if (leaf.nbytes != 0 && base + leaf.nbytes <= bufsize) {
+        // Every pattern lies inside the buffer, no read can throw.
+        uint1 padded[2 * bufsize] = {};
+        memcpy (padded, buf, bufsize);
+        const uint1* window = padded + base;
+        for (uint4 first = leaf.first; first < leaf.first + leaf.count; first += lanechunk) {
+            uint4 n = std::min (leaf.first + leaf.count - first, lanechunk);
+            uint8 bits = matchLanes (window, lanemask[first].bytes, lanevalue[first].bytes, n);
+            while (bits != 0) {
+                const Candidate& cand = candidates[first + __builtin_ctzll (bits)];
+                if (isMatch (cand.context, true, walker, buf, base))
+                    return cand.ct;
+                bits &= bits - 1;
+            }
+        }
+        return nullptr;
+    }
+    for (uint4 i = leaf.first; i != leaf.first + leaf.count; ++i) {
+        const Candidate& cand = candidates[i];
+        if (isMatch (cand.instr, false, walker, buf, base) && isMatch (cand.context, true, walker, buf, base))
+            return cand.ct;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief PatternBlock::isInstructionMatch or PatternBlock::isContextMatch.
+ *
+ * @param[in] base Offset of the current operand in buf.
+ */
+auto
+DecisionTable::isMatch (const Block& blk, bool context, ParserWalker& walker, const uint1* buf,
+                        uint4 base) const -> bool
+
+{
+    if (blk.nonzero <= 0)
+        return blk.nonzero == 0;
+    const uintm* mv = &words[blk.word];
+    int4 off = blk.offset;
+    for (uint4 i = 0; i != blk.nwords; ++i, mv += 2, off += sizeof (uintm)) {
+        uintm data;
+        if (context)
+            data = walker.getContextBytes (off, sizeof (uintm));
+        else if (base + off + sizeof (uintm) <= bufsize) {
+            const uint1* ptr = buf + base + off;
+            data = 0;
+            for (uint4 k = 0; k != sizeof (uintm); ++k)
+                data = (data << 8) | ptr[k];
+        } else                  // past the buffer, throws like the original
+            data = walker.getInstructionBytes (off, sizeof (uintm));
+        if ((mv[0] & data) != mv[1])
+            return false;
+    }
+    return true;
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Constructor of the subtable at root matching the operand the walker is on.
+ *
+ * @param[in] root Node returned by getRoot() for the subtable.
+ * @param[in] walker Walker over the ParserContext being resolved.
+ * @param[in] buf Instruction bytes of that ParserContext.
+ */
+auto
+DecisionTable::resolve (int4 root, ParserWalker& walker, const uint1* buf) const -> Constructor*
+
+{
+    uint4 base = walker.getOffset (-1);
+    const Node* node = &nodes[root];
+    while (node->kind != LEAF) {
+        uintm val;
+        if (node->kind == CONTEXT)
+            val = walker.getContextBits (node->startbit, node->size);
+        else if (node->nbytes != 0 && base + node->byte + node->nbytes <= bufsize) {
+            const uint1* ptr = buf + base + node->byte;
+            val = 0;
+            for (int4 i = 0; i != node->nbytes; ++i)
+                val = (val << 8) | ptr[i];
+            val = (val << node->lshift) >> node->rshift;
+        } else
+            val = walker.getInstructionBits (node->startbit, node->size);
+        node = &nodes[node->first + val];
+    }
+    Constructor* ct = matchLeaf (*node, walker, buf, base);
+    if (ct)
+        return ct;
+    std::ostringstream s;
+    s << walker.getAddr().getShortcut();
+    walker.getAddr().printRaw (s);
+    s << ": Unable to resolve constructor";
+    throw BadDataError (s.str());
+}
@@ -0,0 +1,231 @@
+/**
+ * @file decode-cache.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "../include/coronium/decode-cache.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * static functions
+ *
+ */
+
+/**
+ * @brief Copy the pcode of insn into an arena of its own.
+ */
+static auto
+detach (const Instruction& insn, std::vector<OpBehavior*>& behaviors) -> Instruction
+
+{
+    auto arena = std::make_shared<PcodeArena>();
+    size_t nvnodes = 0;
+    for (auto op : insn.pcode)
+        nvnodes += op.numInput() + (op.getOutput() ? 1 : 0);
+    arena->reserve (insn.pcode.size(), nvnodes);
+
+    PcodeRaw pcode (behaviors, arena);
+    for (auto op : insn.pcode)
+        pcode.dump (op.getAddr(), op.getOpcode(), op.getOutput(),
+                    (op.numInput() != 0) ? op.getInput (0) : nullptr, op.numInput());
+    return Instruction (insn.assembly, std::move (pcode), insn.size);
+}
+
+/*
+ *
+ * DecodeCache
+ *
+ */
+auto
+DecodeCache::KeyHash::operator() (const Key& key) const -> size_t
+
+{
+    size_t h = std::hash<uintb>() (key.addr.getOffset());
+    h ^= std::hash<const void*>() (key.addr.getSpace()) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    for (auto w : key.context)
+        h ^= std::hash<uintm>() (w) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+DecodeCache::DecodeCache (size_t b) : budget (b)
+
+{}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+auto
+DecodeCache::erase (std::list<Entry>::iterator it) -> void
+
+{
+    stats.bytes -= it->footprint;
+    stats.entries -= 1;
+    table.erase (it->key);
+    lru.erase (it);
+}
+
+// --------------------------------------------------------------------------------
+auto
+DecodeCache::shrink (size_t target) -> void
+
+{
+    while (!lru.empty() && stats.bytes > target) {
+        erase (std::prev (lru.end()));
+        stats.evictions += 1;
+    }
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Find the instruction decoded at addr under context.
+ *
+ * @param[in] addr Address of the instruction.
+ * @param[in] context Context words in effect at addr.
+ * @param[in] loader Image the instruction bytes are checked against.
+ * @return The cached instruction (valid until the next call), or nullptr.
+ */
+auto
+DecodeCache::lookup (const Address& addr, const std::vector<uintm>& context, LoadImage* loader) -> const Instruction*
+
+{
+    auto found = table.find (Key { addr, context });
+    if (found == table.end()) {
+        stats.misses += 1;
+        return nullptr;
+    }
+    auto it = found->second;
+
+    uint1 buf[64];
+    std::vector<uint1> big;
+    uint1* cur = buf;
+    if (it->bytes.size() > sizeof (buf)) {
+        big.resize (it->bytes.size());
+        cur = big.data();
+    }
+    bool same;
+    try {
+        loader->loadFill (cur, it->bytes.size(), addr);
+        same = (memcmp (cur, it->bytes.data(), it->bytes.size()) == 0);
+    } catch (DataUnavailError& err) {
+        same = false;
+    }
+    if (!same) {
+        erase (it);
+        stats.invalidations += 1;
+        stats.misses += 1;
+        return nullptr;
+    }
+    lru.splice (lru.begin(), lru, it);
+    stats.hits += 1;
+    return &it->insn;
+}
+
+/**
+ * @brief Remember the instruction decoded at addr under context.
+ *
+ * The pcode is copied, insn itself is left untouched.
+ */
+auto
+DecodeCache::insert (const Address& addr, const std::vector<uintm>& context, const Instruction& insn,
+                     LoadImage* loader) -> void
+
+{
+    Key key { addr, context };
+    auto found = table.find (key);
+    if (found != table.end())
+        erase (found->second);
+
+    Entry entry { key, detach (insn, *insn.pcode.getBehaviors()), std::vector<uint1> (insn.size), 0 };
+    try {
+        loader->loadFill (entry.bytes.data(), insn.size, addr);
+    } catch (DataUnavailError& err) {
+        return;
+    }
+    entry.footprint = sizeof (Entry) + 8 * sizeof (void*) // list node and table slot
+        + context.size() * sizeof (uintm) + entry.bytes.size()
+        + entry.insn.assembly.mnemonic.capacity() + entry.insn.assembly.body.capacity()
+        + sizeof (PcodeArena) + entry.insn.pcode.getArena().memoryUsage();
+    if (entry.footprint > budget)
+        return;
+
+    shrink (budget - entry.footprint);
+    stats.bytes += entry.footprint;
+    stats.entries += 1;
+    lru.push_front (std::move (entry));
+    table.emplace (lru.front().key, lru.begin());
+}
+
+/**
+ * @brief Drop every entry whose bytes overlap rng.
+ */
+auto
+DecodeCache::invalidate (const Range& rng) -> void
+
+{
+    for (auto it = lru.begin(); it != lru.end();) {
+        auto cur = it++;
+        const Address& addr = cur->key.addr;
+        if (addr.getSpace() != rng.getSpace())
+            continue;
+        uintb first = addr.getOffset();
+        uintb last = first + (cur->bytes.empty() ? 0 : cur->bytes.size() - 1);
+        if (first <= rng.getLast() && last >= rng.getFirst()) {
+            erase (cur);
+            stats.invalidations += 1;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------------
+auto
+DecodeCache::clear() -> void
+
+{
+    stats.invalidations += lru.size();
+    table.clear();
+    lru.clear();
+    stats.entries = 0;
+    stats.bytes = 0;
+}
+
+/**
+ * @brief Change the memory budget, evicting least recently used entries if needed.
+ */
+auto
+DecodeCache::setBudget (size_t bytes) -> void
+
+{
+    budget = bytes;
+    shrink (budget);
+}
+
+// --------------------------------------------------------------------------------
+auto
+DecodeCache::resetStats() -> void
+
+{
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.evictions = 0;
+    stats.invalidations = 0;
+}
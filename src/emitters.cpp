@@ -20,10 +20,45 @@
  */
 
 #include "../include/coronium/emitters.hpp"
+#include "../include/coronium/translator.hpp"
 #include <cstdlib>
 
 using namespace coronium;
 
+/*
+ *
+ * static functions
+ *
+ */
+static auto
+appendHex (std::string& out, uintb val) -> void
+
+{
+    char buf[2 + 16];
+    char* p = buf + sizeof (buf);
+    do {
+        *--p = "0123456789abcdef"[val & 0xf];
+        val >>= 4;
+    } while (val != 0);
+    *--p = 'x';
+    *--p = '0';
+    out.append (p, buf + sizeof (buf) - p);
+}
+
+// --------------------------------------------------------------------------------
+static auto
+appendDec (std::string& out, uintb val) -> void
+
+{
+    char buf[20];
+    char* p = buf + sizeof (buf);
+    do {
+        *--p = '0' + (val % 10);
+        val /= 10;
+    } while (val != 0);
+    out.append (p, buf + sizeof (buf) - p);
+}
+
 /*
  *
  * AssemblyRaw
@@ -40,204 +75,204 @@ AssemblyRaw::dump (const Address& addr, const string& mnem, const string& body)-
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  *
- * PcodeRaw
+ * PcodeOpRef
  *
  */
-PcodeRaw::PcodeRaw(std::vector<OpBehavior *> &behavior) : pcode_behaviors(behavior)
+auto
+PcodeOpRef::record() const -> const PcodeArena::OpRecord&
 
-{}
+{
+    return raw->arena->ops[raw->first + index];
+}
 
-PcodeRaw::~PcodeRaw()
+// --------------------------------------------------------------------------------
+auto
+PcodeOpRef::getBehavior() const -> OpBehavior*
 
 {
+    return (*raw->pcode_behaviors)[record().opc];
 }
 
-// The "Instruction" type will manage the lifetime of PcodeRaw
-// (i.e., do not put this into the destructor).
+// --------------------------------------------------------------------------------
 auto
-PcodeRaw::clear_cache (void) -> void
+PcodeOpRef::getSeqNum() const -> SeqNum
 
 {
-    for (auto &i : pcodeOps) {
-        if (i) {
-            delete i;
-            i = nullptr;
-        }
-    }
-    for (auto &i : vnodes_cache) {
-        if (i) {
-            delete i;
-            i = nullptr;
-        }
-    }
+    return SeqNum (raw->address, index);
+}
 
+// --------------------------------------------------------------------------------
+auto
+PcodeOpRef::getAddr() const -> const Address&
+
+{
+    return raw->address;
 }
 
+// --------------------------------------------------------------------------------
+auto
+PcodeOpRef::getOutput() const -> VarnodeData*
+
+{
+    int4 out = record().out;
+    return (out < 0) ? nullptr : &raw->arena->vnodes[out];
+}
+
+// --------------------------------------------------------------------------------
+auto
+PcodeOpRef::getInput (int4 i) const -> VarnodeData*
+
+{
+    return &raw->arena->vnodes[record().in + i];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * PcodeRaw
+ *
+ */
+PcodeRaw::PcodeRaw (std::vector<OpBehavior*>& behavior)
+    : PcodeRaw (behavior, std::make_shared<PcodeArena>())
+
+{}
+
+PcodeRaw::PcodeRaw (std::vector<OpBehavior*>& behavior, std::shared_ptr<PcodeArena> storage)
+    : arena (std::move (storage)), pcode_behaviors (&behavior)
+
+{
+    first = arena->ops.size();
+}
+
+// --------------------------------------------------------------------------------
 auto
 PcodeRaw::dump (const Address& addr, OpCode opc, VarnodeData* outvar, VarnodeData* vars, int4 isize) -> void
 
 {
-    PcodeOpRaw *raw = new PcodeOpRaw();
+    PcodeArena::OpRecord rec;
 
-    raw->setBehavior (pcode_behaviors[opc]);
-    raw->setSeqNum(addr, pcodeOps.size());
+    address = addr;
+    rec.opc = opc;
     if (outvar) {
-        auto *out = new VarnodeData();
-        *out = *outvar;
-        vnodes_cache.push_back(out);
-        raw->setOutput(out);
+        rec.out = arena->vnodes.size();
+        arena->vnodes.push_back (*outvar);
     } else
-        raw->setOutput(nullptr);
+        rec.out = -1;
 
-    for (auto i = 0; i != isize; ++i) {
-        auto *in = new VarnodeData();
-        *in = vars[i];
-        raw->addInput(in);
-        vnodes_cache.push_back(in);
-    }
-    pcodeOps.push_back(raw);
+    rec.in = arena->vnodes.size();
+    rec.nin = isize;
+    arena->vnodes.insert (arena->vnodes.end(), vars, vars + isize);
+    arena->ops.push_back (rec);
+    count += 1;
 }
 
-// --------------------------------------------------------------------------------
+/**
+ * @brief Append one varnode the way print() shows it.
+ *
+ * @param[in,out] names Register table of the last translator seen (looked up again
+ *                      only when the varnode belongs to another translator).
+ */
 auto
-PcodeRaw::print_varnode (std::ostream& s, VarnodeData& vdata) -> void
+PcodeRaw::formatVarnode (std::string& out, const VarnodeData& vdata, const Translate*& trans,
+                         const RegisterNames*& names) -> void
 
 {
-    const Translate* trans = vdata.space->getTrans ();
-    string spacename = vdata.space->getName ();
+    const std::string& spacename = vdata.space->getName();
 
     if (spacename == "unique") {
-        s << '(' << vdata.space->getName()
-          << ',';
-        vdata.space->printOffset (s, vdata.offset);
-        s  << ',' << dec << vdata.size << ')';
+        out += '(';
+        out += spacename;
+        out += ',';
+        appendHex (out, vdata.offset);
+        out += ',';
+        appendDec (out, vdata.size);
+        out += ')';
         return;
     }
 
     if (spacename == "register") {
-        s << trans->getRegisterName (vdata.space, vdata.offset, vdata.size);
+        if (vdata.space->getTrans() != trans) {
+            trans = vdata.space->getTrans();
+            auto* translator = dynamic_cast<const Translator*> (trans);
+            names = translator ? &translator->getRegisterNames() : nullptr;
+        }
+        if (names)
+            out += names->lookup (vdata.space, vdata.offset, vdata.size);
+        else
+            out += trans->getRegisterName (vdata.space, vdata.offset, vdata.size);
     } else {
-        vdata.space->printOffset (s, vdata.offset);
+        appendHex (out, vdata.offset);
     }
 }
 
-// --------------------------------------------------------------------------------
+/**
+ * @brief Append the text of the ops to out.
+ *
+ * Does not allocate once out has grown large enough (reuse it across calls), and
+ * register names come from the translator's RegisterNames table.
+ */
 auto
-PcodeRaw::print (std::ostream& s) -> void
+PcodeRaw::format (std::string& out) const -> void
 
 {
-    for (auto inst : pcodeOps)
-    {
-        VarnodeData* out = inst->getOutput();
-        if (out) {
-            print_varnode (s, *out);
-            s << " = ";
-        }
-
-        std::string op = get_opname (inst->getOpcode());
-        s << op << ' ';
+    const Translate* trans = nullptr;
+    const RegisterNames* names = nullptr;
 
-        if (op == "STORE") {
-            s << "ram[";
-            print_varnode (s, *inst->getInput(1)); // skip over invar 0.
-            s << "] = ";
+    for (auto inst : *this)
+    {
+        VarnodeData* outvar = inst.getOutput();
+        if (outvar) {
+            formatVarnode (out, *outvar, trans, names);
+            out += " = ";
         }
 
-        if (op == "LOAD") {
-            s << "ram[";
-            print_varnode (s, *inst->getInput(1)); // skip over invar 0.
-            s << "]";
+        OpCode opc = inst.getOpcode();
+        out += get_opname (opc);
+        out += ' ';
+
+        int4 i = 0;
+        switch (opc) {
+        case CPUI_STORE:
+            out += "ram[";
+            formatVarnode (out, *inst.getInput (1), trans, names); // skip over invar 0.
+            out += "] = ";
+            i = 2;
+            break;
+        case CPUI_LOAD:
+            out += "ram[";
+            formatVarnode (out, *inst.getInput (1), trans, names); // skip over invar 0.
+            out += "]";
+            i = 2;
+            break;
+        default:
+            break;
         }
 
-        for (int i = (op == "STORE" || op == "LOAD") ? 2 : 0;
-             i != inst->numInput(); ++i)
+        for (; i != inst.numInput(); ++i)
         {
-            print_varnode (s, *inst->getInput(i) );
-            if (i != inst->numInput() - 1)
-                s << ", ";
+            formatVarnode (out, *inst.getInput (i), trans, names);
+            if (i != inst.numInput() - 1)
+                out += ", ";
         }
-        s << "\n";
+        out += '\n';
     }
 }
 
+// --------------------------------------------------------------------------------
+auto
+PcodeRaw::print (std::ostream& s) -> void
+
+{
+    std::string text;
+    format (text);
+    s << text;
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  *
  * Instruction
  *
  */
 Instruction::Instruction (AssemblyRaw assem, PcodeRaw&& rawpc, int4 sz)
-    : pcode (rawpc.pcode_behaviors)
-{
-    size = sz;
-    assembly = assem;
-
-    /* PcodeRaw */
-    pcode.pcodeOps = std::vector<PcodeOpRaw*> (rawpc.pcodeOps.size(), (PcodeOpRaw*)0);
-    for (auto i = 0; i != rawpc.pcodeOps.size(); ++i) {
-        pcode.pcodeOps[i] = rawpc.pcodeOps[i];
-        rawpc.pcodeOps[i] = nullptr;
-    }
-
-    pcode.vnodes_cache = std::vector<VarnodeData*> (rawpc.vnodes_cache.size(), (VarnodeData*)0);
-    for (auto i = 0; i != rawpc.vnodes_cache.size(); ++i) {
-         pcode.vnodes_cache[i] = rawpc.vnodes_cache[i];
-         rawpc.vnodes_cache[i] = nullptr;
-    }
-}
+    : assembly (std::move (assem)), pcode (std::move (rawpc)), size (sz)
 
-/*
- * MOVE CONSTRUCTOR
- */
-Instruction::Instruction (Instruction&& other) noexcept
-    : pcode (other.pcode.pcode_behaviors)
-{
-    size = other.size;
-    assembly = other.assembly;
-
-    /* PcodeRaw */
-    pcode.pcodeOps = std::vector<PcodeOpRaw*> (other.pcode.pcodeOps.size(), (PcodeOpRaw*)0);
-    for (auto i = 0; i != other.pcode.pcodeOps.size(); ++i) {
-        pcode.pcodeOps[i] = other.pcode.pcodeOps[i];
-        other.pcode.pcodeOps[i] = nullptr;
-    }
-    other.pcode.pcodeOps.clear();
-
-    pcode.vnodes_cache = std::vector<VarnodeData*> (other.pcode.vnodes_cache.size(), (VarnodeData*)0);
-    for (auto i = 0; i != other.pcode.vnodes_cache.size(); ++i) {
-        pcode.vnodes_cache[i] = other.pcode.vnodes_cache[i];
-        other.pcode.vnodes_cache[i] = nullptr;
-    }
-    other.pcode.vnodes_cache.clear();
-}
-
-/*
- * COPY CONSTRUCTOR
- */
-Instruction::Instruction (Instruction const& other)
-    : pcode (other.pcode.pcode_behaviors)
-{
-    size = other.size;
-    assembly = other.assembly;
-
-    /* PcodeRaw */
-    pcode.pcodeOps = std::vector<PcodeOpRaw*> (other.pcode.pcodeOps.size(), (PcodeOpRaw*)0);
-    for (auto i = 0; i != other.pcode.pcodeOps.size(); ++i) {
-        auto* rawOp = new PcodeOpRaw();
-        *rawOp = *other.pcode.pcodeOps[i];
-        pcode.pcodeOps[i] = rawOp;
-    }
-
-    pcode.vnodes_cache = std::vector<VarnodeData*> (other.pcode.vnodes_cache.size(), (VarnodeData*)0);
-    for (auto i = 0; i != other.pcode.vnodes_cache.size(); ++i) {
-        auto* vn = new VarnodeData();
-        *vn = *other.pcode.vnodes_cache[i];
-        pcode.vnodes_cache[i] = vn;
-    }
-}
-
-
-Instruction::~Instruction()
-
-{
-    pcode.clear_cache();
-}
+{}
@@ -0,0 +1,356 @@
+/**
+ * @file flow.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "coronium.hpp"
+#include "../include/coronium/flow.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * FlowGraph
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @param[in] c Supplies the translator and the image.
+ * @param[in] bounds Addresses that may be decoded (e.g. the code sections).
+ */
+FlowGraph::FlowGraph (Coronium& c, Range bounds) : coro (c)
+
+{
+    space = bounds.getSpace();
+    first = bounds.getFirst();
+    last = bounds.getLast();
+    visited.reset (new std::atomic<uint8>[(last - first) / 64 + 1]());
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+auto
+FlowGraph::inBounds (const Address& addr) const -> bool
+
+{
+    return addr.getSpace() == space && addr.getOffset() >= first && addr.getOffset() <= last;
+}
+
+/**
+ * @brief Mark addr as visited.
+ *
+ * @return true for the one caller that marked it first.
+ */
+auto
+FlowGraph::claim (const Address& addr) -> bool
+
+{
+    uintb off = addr.getOffset() - first;
+    uint8 bit = (uint8)1 << (off & 63);
+    return (visited[off >> 6].fetch_or (bit, std::memory_order_relaxed) & bit) == 0;
+}
+
+/**
+ * @brief Read the control flow of one instruction off its pcode.
+ *
+ * Branches whose destination is in the constant space stay inside the instruction's
+ * pcode. Ops after one of those may be skipped, so they cannot end the flow.
+ */
+auto
+FlowGraph::analyze (const PcodeRaw& pcode, InsnInfo& info) -> void
+
+{
+    bool conditional = false;
+
+    info.falls = true;
+    info.returns = false;
+    info.indirect = false;
+    for (auto op : pcode) {
+        VarnodeData* dest = (op.numInput() > 0) ? op.getInput (0) : nullptr;
+        switch (op.getOpcode()) {
+        case CPUI_BRANCH:
+        case CPUI_CBRANCH:
+            if (dest->space->getType() == IPTR_CONSTANT) {
+                conditional = true;
+                break;
+            }
+            info.branches.push_back (Address (dest->space, dest->offset));
+            if (op.getOpcode() == CPUI_BRANCH && !conditional)
+                info.falls = false;
+            break;
+        case CPUI_BRANCHIND:
+            info.indirect = true;
+            if (!conditional)
+                info.falls = false;
+            break;
+        case CPUI_CALL:
+            info.calls.push_back (Address (dest->space, dest->offset));
+            break;
+        case CPUI_RETURN:
+            info.returns = true;
+            if (!conditional)
+                info.falls = false;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Decode everything reachable from the entry points.
+ *
+ * A thread takes an address off the worklist, decodes it and pushes the successors it
+ * is first to claim. The walk is over once the list is empty and no thread is busy.
+ */
+auto
+FlowGraph::explore (uint4 nthreads) -> void
+
+{
+    std::vector<Address> work;
+    for (auto& addr : entries)
+        if (inBounds (addr) && claim (addr))
+            work.push_back (addr);
+
+    std::mutex worklock;
+    std::condition_variable wake;
+    uint4 busy = 0;
+    std::vector<std::map<uintb, InsnInfo>> found (nthreads);
+    std::vector<std::vector<Address>> failed (nthreads);
+
+    auto worker = [&] (uint4 id, DecodeContext& ctx) {
+        auto arena = std::make_shared<PcodeArena>();
+        PcodeRaw pcode (coro.pcode_behaviors, arena);
+        std::vector<Address> next;
+        for (;;) {
+            Address addr;
+            {
+                std::unique_lock<std::mutex> guard (worklock);
+                wake.wait (guard, [&] { return !work.empty() || busy == 0; });
+                if (work.empty())
+                    return;
+                addr = work.back();
+                work.pop_back();
+                busy += 1;
+            }
+            next.clear();
+            arena->clear();
+            pcode.clear();
+            try {
+                InsnInfo info;
+                info.length = coro.trans->oneInstruction (ctx, pcode, addr);
+                analyze (pcode, info);
+                if (info.falls)
+                    next.push_back (addr + info.length);
+                next.insert (next.end(), info.branches.begin(), info.branches.end());
+                next.insert (next.end(), info.calls.begin(), info.calls.end());
+                found[id].emplace (addr.getOffset(), std::move (info));
+            } catch (LowlevelError& err) {
+                failed[id].push_back (addr);
+            }
+            // Claim outside the lock, the bitmap is atomic.
+            auto end = std::remove_if (next.begin(), next.end(), [&] (const Address& a) {
+                return !inBounds (a) || !claim (a);
+            });
+            size_t npushed = end - next.begin();
+            {
+                std::lock_guard<std::mutex> guard (worklock);
+                work.insert (work.end(), next.begin(), end);
+                busy -= 1;
+                if (npushed == 0 && !(work.empty() && busy == 0))
+                    continue;
+            }
+            wake.notify_all();
+        }
+    };
+
+    if (nthreads == 1)
+        worker (0, *coro.trans->getDecodeContext());
+    else {
+        std::mutex loadlock;
+        bool shared_loader = coro.isLoaderShareable();
+        std::vector<std::thread> threads;
+        for (uint4 i = 0; i != nthreads; ++i) {
+            threads.emplace_back ([&, i] {
+                SerialImage serial (coro.loader, loadlock);
+                DecodeContext ctx (*coro.trans, shared_loader ? coro.loader : &serial, coro.context);
+                ctx.allowContextSet (false);
+                worker (i, ctx);
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+    }
+
+    for (auto& part : found)
+        insns.insert (std::make_move_iterator (part.begin()), std::make_move_iterator (part.end()));
+    for (auto& part : failed)
+        errors.insert (errors.end(), part.begin(), part.end());
+    std::sort (errors.begin(), errors.end());
+}
+
+/**
+ * @brief Cut the decoded instructions into basic blocks.
+ *
+ * Blocks start at entry points, branch and call targets, and after any instruction
+ * that branches. They end at a branch, a return, or before another block's start.
+ */
+auto
+FlowGraph::buildBlocks() -> void
+
+{
+    auto ends = [] (const InsnInfo& info) {
+        return !info.falls || info.indirect || info.returns || !info.branches.empty();
+    };
+    std::set<uintb> leaders;
+    for (auto& addr : entries)
+        if (inBounds (addr))
+            leaders.insert (addr.getOffset());
+    for (auto& i : insns) {
+        for (auto& target : i.second.branches)
+            if (inBounds (target))
+                leaders.insert (target.getOffset());
+        for (auto& target : i.second.calls)
+            if (inBounds (target))
+                leaders.insert (target.getOffset());
+        if (ends (i.second) && i.second.falls)
+            leaders.insert (i.first + i.second.length);
+    }
+
+    blocks.clear();
+    for (auto off : leaders) {
+        auto it = insns.find (off);
+        if (it == insns.end())
+            continue;           // not decoded (bad data)
+        BasicBlock block;
+        block.start = Address (space, off);
+        for (;;) {
+            const InsnInfo& info = it->second;
+            uintb next = it->first + info.length;
+            block.size += info.length;
+            block.ninsns += 1;
+            block.calls.insert (block.calls.end(), info.calls.begin(), info.calls.end());
+            if (ends (info)) {
+                block.successors = info.branches;
+                if (info.falls)
+                    block.successors.push_back (Address (space, next));
+                block.returns = info.returns;
+                block.indirect = info.indirect;
+                break;
+            }
+            auto following = insns.find (next);
+            if (following == insns.end() || leaders.count (next) != 0) {
+                block.successors.push_back (Address (space, next));
+                break;
+            }
+            it = following;
+        }
+        blocks.emplace (block.start, std::move (block));
+    }
+}
+
+/**
+ * @brief Group the blocks reachable from each entry point and call target.
+ */
+auto
+FlowGraph::buildFunctions() -> void
+
+{
+    std::set<Address> heads;
+    for (auto& addr : entries)
+        if (blocks.count (addr))
+            heads.insert (addr);
+    for (auto& b : blocks)
+        for (auto& target : b.second.calls)
+            if (blocks.count (target))
+                heads.insert (target);
+
+    functions.clear();
+    for (auto& head : heads) {
+        FlowFunction func;
+        func.entry = head;
+        std::set<Address> seen { head };
+        std::vector<Address> todo { head };
+        while (!todo.empty()) {
+            const BasicBlock& block = blocks.find (todo.back())->second;
+            todo.pop_back();
+            func.blocks.push_back (block.start);
+            func.callees.insert (block.calls.begin(), block.calls.end());
+            for (auto& succ : block.successors)
+                if (blocks.count (succ) && seen.insert (succ).second)
+                    todo.push_back (succ);
+        }
+        std::sort (func.blocks.begin(), func.blocks.end());
+        functions.emplace (head, std::move (func));
+    }
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+auto
+FlowGraph::addEntry (const Address& addr) -> void
+
+{
+    entries.push_back (addr);
+}
+
+/**
+ * @brief Follow the flow from the entry points and build the blocks and functions.
+ *
+ * May be called again after adding entry points, only new code is decoded.
+ *
+ * @param[in] nthreads Number of threads (0 means one per hardware thread).
+ */
+auto
+FlowGraph::run (uint4 nthreads) -> void
+
+{
+    if (nthreads == 0)
+        nthreads = std::max (1u, std::thread::hardware_concurrency());
+    explore (nthreads);
+    buildBlocks();
+    buildFunctions();
+}
+
+// --------------------------------------------------------------------------------
+auto
+FlowGraph::getBlock (const Address& addr) const -> const BasicBlock*
+
+{
+    auto it = blocks.find (addr);
+    return (it == blocks.end()) ? nullptr : &it->second;
+}
+
+/**
+ * @return For every function, the entry points of the functions it calls.
+ */
+auto
+FlowGraph::getCallGraph() const -> std::map<Address, std::set<Address>>
+
+{
+    std::map<Address, std::set<Address>> graph;
+    for (auto& f : functions)
+        graph[f.first] = f.second.callees;
+    return graph;
+}
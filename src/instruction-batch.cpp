@@ -0,0 +1,174 @@
+/**
+ * @file instruction-batch.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/coronium/instruction-batch.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * MnemonicTable
+ *
+ */
+auto
+MnemonicTable::intern (const std::string& mnem) -> uint4
+
+{
+    auto res = ids.emplace (mnem, names.size());
+    if (res.second)
+        names.push_back (mnem);
+    return res.first->second;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * InstructionBatch
+ *
+ */
+void
+InstructionBatch::AsmSink::dump (const Address& addr, const std::string& mnem, const std::string& body)
+
+{
+    batch->space = addr.getSpace();
+    batch->addrs.push_back (addr.getOffset());
+    batch->mnemonic_ids.push_back (batch->mnemonics->intern (mnem));
+    batch->text += body;
+    batch->text_start.push_back (batch->text.size());
+}
+
+// --------------------------------------------------------------------------------
+void
+InstructionBatch::PcodeSink::dump (const Address&, OpCode opc, VarnodeData* outvar, VarnodeData* vars, int4 isize)
+
+{
+    batch->opcodes.push_back (opc);
+    batch->op_out.push_back (outvar ? (int4)batch->addVarnode (*outvar) : -1);
+    batch->op_in.push_back (batch->vn_offset.size());
+    batch->op_nin.push_back (isize);
+    for (int4 i = 0; i != isize; ++i)
+        batch->addVarnode (vars[i]);
+}
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+InstructionBatch::InstructionBatch (std::shared_ptr<MnemonicTable> table) : mnemonics (std::move (table))
+
+{}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+auto
+InstructionBatch::addVarnode (const VarnodeData& vn) -> uint4
+
+{
+    int4 index = vn.space->getIndex();
+    if ((size_t)index >= spaces.size())
+        spaces.resize (index + 1, nullptr);
+    spaces[index] = vn.space;
+    vn_space.push_back (index);
+    vn_offset.push_back (vn.offset);
+    vn_size.push_back (vn.size);
+    return vn_offset.size() - 1;
+}
+
+/**
+ * @brief Shrink every column back to the given sizes.
+ */
+auto
+InstructionBatch::truncate (size_t ninsns, size_t nops, size_t nvns) -> void
+
+{
+    addrs.resize (ninsns);
+    lengths.resize (ninsns);
+    mnemonic_ids.resize (ninsns);
+    text.resize (text_start[ninsns]);
+    text_start.resize (ninsns + 1);
+    op_start.resize (ninsns + 1);
+    opcodes.resize (nops);
+    op_out.resize (nops);
+    op_in.resize (nops);
+    op_nin.resize (nops);
+    vn_space.resize (nvns);
+    vn_offset.resize (nvns);
+    vn_size.resize (nvns);
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Decode the instruction at addr onto the end of the batch.
+ *
+ * If decoding throws, the batch is left as it was.
+ *
+ * @return Length of the instruction.
+ */
+auto
+InstructionBatch::append (const Translator& trans, DecodeContext& ctx, const Address& addr) -> int4
+
+{
+    size_t n = size();
+    size_t nops = opcodes.size();
+    size_t nvns = vn_offset.size();
+    AsmSink asm_emit;
+    PcodeSink pcode_emit;
+    asm_emit.batch = this;
+    pcode_emit.batch = this;
+
+    int4 length;
+    try {
+        length = trans.decode (ctx, asm_emit, pcode_emit, addr);
+    } catch (...) {
+        truncate (n, nops, nvns);
+        throw;
+    }
+    lengths.push_back (length);
+    op_start.push_back (opcodes.size());
+    return length;
+}
+
+// --------------------------------------------------------------------------------
+auto
+InstructionBatch::reserve (size_t ninsns, size_t nops) -> void
+
+{
+    addrs.reserve (ninsns);
+    lengths.reserve (ninsns);
+    mnemonic_ids.reserve (ninsns);
+    text_start.reserve (ninsns + 1);
+    op_start.reserve (ninsns + 1);
+    opcodes.reserve (nops);
+    op_out.reserve (nops);
+    op_in.reserve (nops);
+    op_nin.reserve (nops);
+    vn_space.reserve (nops * 3);
+    vn_offset.reserve (nops * 3);
+    vn_size.reserve (nops * 3);
+}
+
+// --------------------------------------------------------------------------------
+auto
+InstructionBatch::getVarnode (uint4 vn) const -> VarnodeData
+
+{
+    VarnodeData data;
+    data.space = spaces[vn_space[vn]];
+    data.offset = vn_offset[vn];
+    data.size = vn_size[vn];
+    return data;
+}
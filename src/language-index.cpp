@@ -0,0 +1,361 @@
+/**
+ * @file language-index.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>               // rename
+#include <cstdlib>              // strtoll
+#include <dirent.h>             // DIR
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>             // getpid
+
+#include "xml.hh"
+#include "../include/coronium/language-index.hpp"
+#include "../include/coronium/sla-pack.hpp"
+
+using namespace coronium;
+
+const char* LanguageIndex::filename = "coronium.index";
+
+/*
+ *
+ * static functions
+ *
+ */
+static const char* index_magic = "coronium-index 3";
+
+// Process wide registry of indexes, keyed by directory.
+static std::mutex registry_lock;
+static std::unordered_map<std::string, std::shared_ptr<LanguageIndex>> registry;
+
+/**
+ * @brief Whether entry is a file coronium writes itself (index, .sla packs, and their
+ * temporary files), which must not make the index stale.
+ */
+static auto
+isScratch (const std::string& entry) -> bool
+
+{
+    std::string own = LanguageIndex::filename;
+    return (entry.compare (0, own.length(), own) == 0) ||
+        (entry.find (SlaPack::extension) != std::string::npos);
+}
+
+/**
+ * @brief Stamp of path: the mtime of a file, a hash of the names in a directory.
+ *
+ * The mtime of a directory changes whenever coronium writes a pack or the index into
+ * it, so the names it holds are hashed instead (FNV-1a), without the scratch files.
+ *
+ * @return -1 if path does not exist.
+ */
+static auto
+stampOf (const std::string& path) -> long long
+
+{
+    struct stat st;
+    if (stat (path.c_str(), &st) != 0)
+        return -1;
+    if (!S_ISDIR (st.st_mode))
+        return (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    DIR* dir = opendir (path.c_str ());
+    struct dirent* dp;
+
+    if (!dir)
+        return -1;
+    std::vector<std::string> names;
+    while (dp = readdir (dir), dp != nullptr) {
+        auto entry = std::string (dp->d_name);
+        if (entry != "." && entry != ".." && !isScratch (entry))
+            names.push_back (entry);
+    }
+    closedir (dir);
+    std::sort (names.begin(), names.end());
+
+    unsigned long long hash = 14695981039346656037ULL;
+    for (auto& name : names)
+        for (unsigned char c : name + '/') {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+    return (long long)(hash >> 1);
+}
+
+/**
+ * @brief Parse a whole field as a decimal number.
+ *
+ * @return false if field is empty, not a number or out of range.
+ */
+static auto
+parseNumber (const std::string& field, long long& value) -> bool
+
+{
+    if (field.empty())
+        return false;
+    char* end;
+    errno = 0;
+    value = std::strtoll (field.c_str(), &end, 10);
+    return (errno == 0) && (*end == '\0');
+}
+
+// --------------------------------------------------------------------------------
+static auto
+endsWith (const std::string& str, const std::string& suffix) -> bool
+
+{
+    return str.length() >= suffix.length() &&
+        str.compare (str.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+// --------------------------------------------------------------------------------
+static auto
+lowercase (std::string str) -> std::string
+
+{
+    for (auto& c : str)
+        c = std::tolower (c);
+    return str;
+}
+
+// --------------------------------------------------------------------------------
+static auto
+walk (const std::string& dirname, std::map<std::string, long long>& stamps,
+      std::vector<std::string>& ldefs, std::vector<std::string>& pspecs) -> void
+
+{
+    DIR* dir = opendir (dirname.c_str ());
+    struct dirent* dp;
+
+    if (!dir)
+        return;
+    stamps[dirname] = stampOf (dirname);
+
+    while (dp = readdir (dir), dp != nullptr) {
+        auto entry = std::string (dp->d_name);
+
+        if (entry == "." || entry == "..")
+            continue;
+
+        std::string path = (dirname + "/" + entry);
+
+        if (endsWith (entry, ".ldefs")) {
+            ldefs.push_back (path);
+            stamps[path] = stampOf (path);
+        } else if (endsWith (entry, ".pspec")) {
+            pspecs.push_back (path);
+            stamps[path] = stampOf (path);
+        } else
+            walk (path, stamps, ldefs, pspecs);
+    }
+    closedir (dir);
+}
+
+/*
+ *
+ * LanguageIndex
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+LanguageIndex::LanguageIndex (std::string dir) : directory (dir)
+
+{
+    if (read (directory + "/" + filename))
+        return;
+    crawl();
+    save();                     // Best effort, the directory may not be writable.
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+ * @brief Build the index from scratch by walking the directory tree once.
+ */
+auto
+LanguageIndex::crawl() -> void
+
+{
+    std::vector<std::string> ldefs_files;
+    std::vector<std::string> pspec_files;
+
+    languages.clear();
+    stamps.clear();
+    walk (directory, stamps, ldefs_files, pspec_files);
+
+    for (auto& f : ldefs_files) {
+        DocumentStorage doc;
+        Element* root;
+        try {
+            root = doc.openDocument (f)->getRoot();
+        } catch (XmlError& err) {
+            continue;           // Not our problem unless someone asks for this language.
+        }
+        std::string cpu_dir = f.substr (0, f.find_last_of ("/\\"));
+
+        for (auto el : root->getChildren()) {
+            LanguageRecord rec;
+            rec.cpu_dir = cpu_dir;
+            for (auto i = 0; i != el->getNumAttributes (); ++i)
+                rec.ldefs[el->getAttributeName (i)] = el->getAttributeValue (i);
+
+            // The .pspec lives somewhere below the .ldefs, name compared case insensitively.
+            std::string pspec = lowercase (rec.ldefs["processorspec"]);
+            for (auto& p : pspec_files) {
+                if (p.compare (0, cpu_dir.length() + 1, cpu_dir + "/") != 0)
+                    continue;
+                if (lowercase (p.substr (p.find_last_of ("/\\") + 1)) == pspec) {
+                    rec.pspec = p;
+                    break;
+                }
+            }
+            languages[el->getAttributeValue ("id")] = rec;
+        }
+    }
+}
+
+/**
+ * @brief Load a saved index.
+ *
+ * @param[in] path Index file.
+ * @return false if the file is missing, malformed (e.g. cut short) or stale.
+ */
+auto
+LanguageIndex::read (const std::string& path) -> bool
+
+{
+    std::ifstream in (path);
+    std::string line;
+
+    if (!in || !std::getline (in, line) || line != index_magic)
+        return false;
+
+    LanguageRecord* rec = nullptr;
+    bool ended = false;
+    while (std::getline (in, line)) {
+        if (ended)
+            return false;
+        std::vector<std::string> fields;
+        std::istringstream ls (line);
+        std::string field;
+        while (std::getline (ls, field, '\t'))
+            fields.push_back (field);
+
+        long long number;
+        if (fields.size() == 3 && fields[0] == "S") {
+            if (!parseNumber (fields[1], number) || stampOf (fields[2]) != number)
+                return false;
+            stamps[fields[2]] = number;
+        } else if (fields.size() == 4 && fields[0] == "L") {
+            rec = &languages[fields[1]];
+            rec->cpu_dir = fields[2];
+            rec->pspec = fields[3];
+        } else if (fields.size() >= 2 && fields[0] == "A" && rec) {
+            rec->ldefs[fields[1]] = (fields.size() == 3) ? fields[2] : "";
+        } else if (fields.size() == 2 && fields[0] == "E") {
+            if (!parseNumber (fields[1], number) || (size_t)number != languages.size())
+                return false;
+            ended = true;
+        } else
+            return false;
+    }
+    return ended;
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Return the (shared) index for dir, building or loading it on first use.
+ */
+auto
+LanguageIndex::get (const std::string& dir) -> std::shared_ptr<LanguageIndex>
+
+{
+    std::lock_guard<std::mutex> guard (registry_lock);
+    auto& entry = registry[dir];
+    if (!entry)
+        entry = std::make_shared<LanguageIndex> (dir);
+    return entry;
+}
+
+/**
+ * @brief Forget every index, the next get() revalidates against the filesystem.
+ */
+auto
+LanguageIndex::clearRegistry() -> void
+
+{
+    std::lock_guard<std::mutex> guard (registry_lock);
+    registry.clear();
+}
+
+// --------------------------------------------------------------------------------
+auto
+LanguageIndex::find (const std::string& id) const -> const LanguageRecord*
+
+{
+    auto it = languages.find (id);
+    return (it == languages.end()) ? nullptr : &it->second;
+}
+
+/**
+ * @brief Write the index into its directory.
+ *
+ * The index is written to a temporary file and renamed into place, so a concurrent
+ * reader sees either the old or the new index. It ends with a record of the number of
+ * languages, a file cut short is rejected by read().
+ *
+ * @return false if the directory is not writable.
+ */
+auto
+LanguageIndex::save() -> bool
+
+{
+    std::string path = directory + "/" + filename;
+    std::string tmpfile = path + ".tmp" + std::to_string (getpid());
+    {
+        std::ofstream out (tmpfile, std::ios::trunc);
+        if (!out)
+            return false;
+        out << index_magic << '\n';
+        for (auto& s : stamps)
+            out << "S\t" << s.second << '\t' << s.first << '\n';
+        for (auto& l : languages) {
+            out << "L\t" << l.first << '\t' << l.second.cpu_dir << '\t' << l.second.pspec << '\n';
+            for (auto& a : l.second.ldefs)
+                out << "A\t" << a.first << '\t' << a.second << '\n';
+        }
+        out << "E\t" << languages.size() << '\n';
+        if (!out) {
+            remove (tmpfile.c_str());
+            return false;
+        }
+    }
+    if (rename (tmpfile.c_str(), path.c_str()) != 0) {
+        remove (tmpfile.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file parser-cache.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "../include/coronium/parser-cache.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * ParserCache
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @param[in] ccache Context front-end the parses load their context from.
+ * @param[in] cspace The constant address space.
+ * @param[in] size Number of parses kept (second level).
+ * @param[in] windowsize Number of direct-mapped slots (first level), a power of 2.
+ */
+ParserCache::ParserCache (ContextCache* ccache, AddrSpace* cspace, int4 size, int4 windowsize)
+    : contextcache (ccache), constspace (cspace), capacity (size), mask (windowsize - 1)
+
+{
+    if (size < 1)
+        throw LowlevelError ("Bad size for parser cache");
+    if ((windowsize < 1) || ((windowsize & (windowsize - 1)) != 0))
+        throw LowlevelError ("Bad windowsize for parser cache");
+    window.assign (windowsize, nullptr);
+    entries.reserve (size);
+    table.reserve (size);
+    lru.prev = lru.next = &lru;
+}
+
+ParserCache::~ParserCache()
+
+{
+    for (auto& e : entries)
+        delete e.pos;
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+auto
+ParserCache::unlink (Entry* e) -> void
+
+{
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+}
+
+// --------------------------------------------------------------------------------
+auto
+ParserCache::pushFront (Entry* e) -> void
+
+{
+    e->prev = &lru;
+    e->next = lru.next;
+    lru.next->prev = e;
+    lru.next = e;
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief The cached parse of addr, in whatever state it was left.
+ *
+ * @return nullptr if no parse for addr is cached.
+ */
+auto
+ParserCache::lookup (const Address& addr) -> ParserContext*
+
+{
+    Entry*& slot = window[(uint4)addr.getOffset() & mask];
+    Entry* e = slot;
+    if ((e == nullptr) || (e->pos->getAddr() != addr)) {
+        auto it = table.find (addr);
+        if (it == table.end())
+            return nullptr;
+        e = it->second;
+        slot = e;
+    }
+    if (lru.next != e) {
+        unlink (e);
+        pushFront (e);
+    }
+    return e->pos;
+}
+
+/**
+ * @brief An uninitialized parse for addr, which must not be cached already.
+ *
+ * @param[in] addr Address of the instruction.
+ * @param[out] evicted Set if the parse of another address was dropped to make room.
+ */
+auto
+ParserCache::insert (const Address& addr, bool& evicted) -> ParserContext*
+
+{
+    Entry* e;
+    evicted = false;
+    if (entries.size() < (size_t)capacity) {
+        ParserContext* pos = new ParserContext (contextcache);
+        pos->initialize (75, 20, constspace); // same as DisassemblyCache
+        entries.push_back (Entry { pos, nullptr, nullptr });
+        e = &entries.back();
+    } else {
+        e = lru.prev;
+        unlink (e);
+        auto it = table.find (e->pos->getAddr());
+        if ((it != table.end()) && (it->second == e)) {
+            table.erase (it);
+            evicted = true;
+        }
+    }
+    pushFront (e);
+    e->pos->setAddr (addr);
+    e->pos->setParserState (ParserContext::uninitialized);
+    table[addr] = e;
+    window[(uint4)addr.getOffset() & mask] = e;
+    return e->pos;
+}
+
+/**
+ * @brief Forget every parse. The ParserContexts stay allocated for reuse.
+ */
+auto
+ParserCache::clear() -> void
+
+{
+    table.clear();
+    std::fill (window.begin(), window.end(), nullptr);
+}
@@ -0,0 +1,459 @@
+/**
+ * @file pcode-file.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/coronium/pcode-file.hpp"
+#include "../include/coronium/translator.hpp"
+
+using namespace coronium;
+
+static const char MAGIC[8] = { 'C', 'O', 'R', 'P', 'C', 'D', '1', '\n' };
+static const size_t TRAILER_SIZE = 8 + 8 + sizeof (MAGIC);
+
+// --------------------------------------------------------------------------------
+static auto
+put_varint (std::string& out, uintb val) -> void
+
+{
+    while (val >= 0x80) {
+        out += (char)(val | 0x80);
+        val >>= 7;
+    }
+    out += (char)val;
+}
+
+// --------------------------------------------------------------------------------
+static auto
+put_string (std::string& out, const std::string& str) -> void
+
+{
+    put_varint (out, str.size());
+    out += str;
+}
+
+/**
+ * @brief Unchecked varint, for records already checked by check_record().
+ */
+static auto
+get_varint (const uint1*& pos) -> uintb
+
+{
+    uintb val = 0;
+    int4 shift = 0;
+    for (;;) {
+        uint1 byte = *pos++;
+        val |= (uintb)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return val;
+        shift += 7;
+    }
+}
+
+/**
+ * @brief Bounds checked varint, used for the tables and the record walk at open.
+ */
+static auto
+get_varint_checked (const uint1*& pos, const uint1* end) -> uintb
+
+{
+    uintb val = 0;
+    for (int4 shift = 0; pos != end && shift < 64; shift += 7) {
+        uint1 byte = *pos++;
+        val |= (uintb)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return val;
+    }
+    throw LowlevelError ("Corrupt pcode file (bad varint)");
+}
+
+/**
+ * @brief Check that a record decodes inside [pos, end) and only uses ids of the tables.
+ *
+ * @return false if it does not, the varints throw if they run past end.
+ */
+static auto
+check_record (const uint1* pos, const uint1* end, uintb nspaces, uintb nmnemonics) -> bool
+
+{
+    const uintb max4 = 0xffffffff;  // fields read into a uint4
+    auto varnode = [&]() {
+        uintb space = get_varint_checked (pos, end);
+        get_varint_checked (pos, end);
+        return space < nspaces && get_varint_checked (pos, end) <= max4;
+    };
+    if (get_varint_checked (pos, end) >= nspaces)
+        return false;
+    get_varint_checked (pos, end);
+    if (get_varint_checked (pos, end) > max4 || get_varint_checked (pos, end) >= nmnemonics)
+        return false;
+    uintb body = get_varint_checked (pos, end);
+    if (body > (uintb)(end - pos))
+        return false;
+    pos += body;
+    // An op takes 2 bytes at least, a varnode 3.
+    uintb nops = get_varint_checked (pos, end);
+    if (nops > (uintb)(end - pos) / 2)
+        return false;
+    for (uintb i = 0; i != nops; ++i) {
+        if (pos == end || *pos++ >= CPUI_MAX)
+            return false;
+        uintb shape = get_varint_checked (pos, end);
+        if ((shape >> 1) > (uintb)(end - pos) / 3)
+            return false;
+        for (uintb n = (shape >> 1) + (shape & 1); n != 0; --n)
+            if (!varnode())
+                return false;
+    }
+    return pos == end;
+}
+
+// --------------------------------------------------------------------------------
+static auto
+get_le8 (const uint1* pos) -> uint8
+
+{
+    uint8 val = 0;
+    for (int4 i = 7; i >= 0; --i)
+        val = (val << 8) | pos[i];
+    return val;
+}
+
+/*
+ *
+ * PcodeWriter
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+PcodeWriter::PcodeWriter (const std::string& p) : path (p), out (p, std::ios::binary | std::ios::trunc)
+
+{
+    if (!out)
+        throw LowlevelError ("Unable to open " + path + " for writing");
+    out.write (MAGIC, sizeof (MAGIC));
+    position = sizeof (MAGIC);
+}
+
+/**
+ * @brief Remove the file if close() was not called, it has no tables nor trailer.
+ */
+PcodeWriter::~PcodeWriter()
+
+{
+    if (out.is_open()) {
+        out.close();
+        std::remove (path.c_str());
+    }
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+auto
+PcodeWriter::spaceId (const AddrSpace* space) -> uint4
+
+{
+    auto res = space_ids.emplace (space, space_names.size());
+    if (res.second)
+        space_names.push_back (space->getName());
+    return res.first->second;
+}
+
+/**
+ * @brief Append vn to the record, interning its name if it is a register.
+ */
+auto
+PcodeWriter::putVarnode (const VarnodeData& vn) -> void
+
+{
+    uint4 id = spaceId (vn.space);
+    put_varint (record, id);
+    put_varint (record, vn.offset);
+    put_varint (record, vn.size);
+    if (vn.space->getType() != IPTR_PROCESSOR || vn.space->getName() != "register")
+        return;
+    RegKey key { id, vn.offset, vn.size };
+    if (registers.count (key))
+        return;
+    if (vn.space->getTrans() != trans) {
+        trans = vn.space->getTrans();
+        auto* translator = dynamic_cast<const Translator*> (trans);
+        regnames = translator ? &translator->getRegisterNames() : nullptr;
+    }
+    registers.emplace (key, regnames ? regnames->lookup (vn.space, vn.offset, vn.size)
+                                     : trans->getRegisterName (vn.space, vn.offset, vn.size));
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+auto
+PcodeWriter::write (const Instruction& insn) -> void
+
+{
+    const Address& addr = insn.assembly.address;
+    auto res = mnemonic_ids.emplace (insn.assembly.mnemonic, mnemonic_names.size());
+    if (res.second)
+        mnemonic_names.push_back (insn.assembly.mnemonic);
+
+    record.clear();
+    put_varint (record, spaceId (addr.getSpace()));
+    put_varint (record, addr.getOffset());
+    put_varint (record, insn.size);
+    put_varint (record, res.first->second);
+    put_string (record, insn.assembly.body);
+    put_varint (record, insn.pcode.size());
+    for (auto op : insn.pcode) {
+        VarnodeData* outvar = op.getOutput();
+        record += (char)op.getOpcode();
+        put_varint (record, ((uintb)op.numInput() << 1) | (outvar != nullptr));
+        if (outvar)
+            putVarnode (*outvar);
+        for (int4 i = 0; i != op.numInput(); ++i)
+            putVarnode (*op.getInput (i));
+    }
+
+    std::string length;
+    put_varint (length, record.size());
+    out.write (length.data(), length.size());
+    out.write (record.data(), record.size());
+    position += length.size() + record.size();
+    ninsns += 1;
+}
+
+/**
+ * @brief Write the tables and the trailer and close the file.
+ */
+auto
+PcodeWriter::close() -> void
+
+{
+    uint8 tables = position;
+    record.clear();
+    put_varint (record, space_names.size());
+    for (auto& name : space_names)
+        put_string (record, name);
+    put_varint (record, mnemonic_names.size());
+    for (auto& name : mnemonic_names)
+        put_string (record, name);
+    put_varint (record, registers.size());
+    for (auto& reg : registers) {
+        put_varint (record, reg.first.space);
+        put_varint (record, reg.first.offset);
+        put_varint (record, reg.first.size);
+        put_string (record, reg.second);
+    }
+    for (uint8 val : { tables, ninsns })
+        for (int4 i = 0; i != 8; ++i)
+            record += (char)(val >> (8 * i));
+    record.append (MAGIC, sizeof (MAGIC));
+    out.write (record.data(), record.size());
+    out.close();
+    if (out.fail())
+        throw LowlevelError ("Error writing pcode file");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * PcodeReader
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Map path and read its tables.
+ *
+ * Every record is walked once here (varints, lengths, op counts and table ids), so
+ * iterating afterwards stays inside the mapping without further checks.
+ */
+PcodeReader::PcodeReader (const std::string& path)
+
+{
+    int fd = open (path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw LowlevelError ("Unable to open " + path);
+    struct stat st;
+    if (fstat (fd, &st) != 0 || (size_t)st.st_size < sizeof (MAGIC) + TRAILER_SIZE) {
+        ::close (fd);
+        throw LowlevelError (path + " is not a pcode file");
+    }
+    mapsize = st.st_size;
+    void* map = mmap (nullptr, mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close (fd);
+    if (map == MAP_FAILED)
+        throw LowlevelError ("Unable to map " + path);
+    base = (const uint1*)map;
+
+    try {
+        const uint1* trailer = base + mapsize - TRAILER_SIZE;
+        if (std::memcmp (base, MAGIC, sizeof (MAGIC)) != 0 ||
+            std::memcmp (trailer + 16, MAGIC, sizeof (MAGIC)) != 0)
+            throw LowlevelError (path + " is not a pcode file");
+        uint8 offset = get_le8 (trailer);
+        ninsns = get_le8 (trailer + 8);
+        if (offset < sizeof (MAGIC) || offset > (uint8)(trailer - base))
+            throw LowlevelError ("Corrupt pcode file " + path);
+        records = base + sizeof (MAGIC);
+        tables = base + offset;
+
+        const uint1* pos = tables;
+        auto text = [&]() {
+            uintb length = get_varint_checked (pos, trailer);
+            if (length > (uintb)(trailer - pos))
+                throw LowlevelError ("Corrupt pcode file " + path);
+            Text t { (const char*)pos, (uint4)length };
+            pos += length;
+            return t;
+        };
+        // A string takes 1 byte at least, which bounds the table sizes.
+        auto count = [&]() {
+            uintb n = get_varint_checked (pos, trailer);
+            if (n > (uintb)(trailer - pos))
+                throw LowlevelError ("Corrupt pcode file " + path);
+            return n;
+        };
+        spaces.resize (count());
+        for (auto& t : spaces)
+            t = text();
+        mnemonics.resize (count());
+        for (auto& t : mnemonics)
+            t = text();
+        uintb nregs = count();
+        for (uintb i = 0; i != nregs; ++i) {
+            RegKey key;
+            key.space = get_varint_checked (pos, trailer);
+            key.offset = get_varint_checked (pos, trailer);
+            key.size = get_varint_checked (pos, trailer);
+            registers.emplace (key, text());
+        }
+
+        uint8 nrecords = 0;
+        for (pos = records; pos != tables; ++nrecords) {
+            uintb length = get_varint_checked (pos, tables);
+            if (length > (uintb)(tables - pos))
+                throw LowlevelError ("Corrupt pcode file " + path);
+            if (!check_record (pos, pos + length, spaces.size(), mnemonics.size()))
+                throw LowlevelError ("Corrupt pcode file " + path);
+            pos += length;
+        }
+        if (nrecords != ninsns)
+            throw LowlevelError ("Corrupt pcode file " + path);
+    } catch (...) {
+        munmap (map, mapsize);
+        throw;
+    }
+}
+
+// --------------------------------------------------------------------------------
+PcodeReader::~PcodeReader()
+
+{
+    munmap ((void*)base, mapsize);
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+auto
+PcodeReader::decodeInsn (const PcodeReader* reader, const uint1* pos, Insn& insn) -> void
+
+{
+    uintb length = get_varint (pos);
+    insn.reader = reader;
+    insn.next = pos + length;
+    insn.space = get_varint (pos);
+    insn.offset = get_varint (pos);
+    insn.length = get_varint (pos);
+    insn.mnemonic = get_varint (pos);
+    insn.body.size = get_varint (pos);
+    insn.body.data = (const char*)pos;
+    pos += insn.body.size;
+    insn.nops = get_varint (pos);
+    insn.ops = pos;
+}
+
+// --------------------------------------------------------------------------------
+auto
+PcodeReader::decodeOp (const uint1* pos, Op& op) -> void
+
+{
+    op.opcode = (OpCode)*pos++;
+    uintb shape = get_varint (pos);
+    op.ninputs = shape >> 1;
+    op.has_output = shape & 1;
+    if (op.has_output) {
+        op.out.space = get_varint (pos);
+        op.out.offset = get_varint (pos);
+        op.out.size = get_varint (pos);
+    }
+    op.inputs = pos;
+    for (uint4 i = 0; i != 3 * op.ninputs; ++i)
+        get_varint (pos);
+    op.next = pos;
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @return Name of the register vn is, nullptr if it is not a register.
+ */
+auto
+PcodeReader::getRegisterName (const Varnode& vn) const -> const Text*
+
+{
+    auto it = registers.find (RegKey { vn.space, vn.offset, vn.size });
+    return (it == registers.end()) ? nullptr : &it->second;
+}
+
+// --------------------------------------------------------------------------------
+auto
+PcodeReader::Op::getInput (uint4 i) const -> Varnode
+
+{
+    const uint1* pos = inputs;
+    for (uint4 skip = 0; skip != 3 * i; ++skip)
+        get_varint (pos);
+    Varnode vn;
+    vn.space = get_varint (pos);
+    vn.offset = get_varint (pos);
+    vn.size = get_varint (pos);
+    return vn;
+}
+
+// --------------------------------------------------------------------------------
+PcodeReader::const_iterator::const_iterator (const PcodeReader* r, const uint1* p) : reader (r), pos (p)
+
+{
+    if (pos != reader->tables)
+        decodeInsn (reader, pos, insn);
+}
+
+// --------------------------------------------------------------------------------
+auto
+PcodeReader::const_iterator::operator++ () -> const_iterator&
+
+{
+    pos = insn.next;
+    if (pos != reader->tables)
+        decodeInsn (reader, pos, insn);
+    return *this;
+}
@@ -0,0 +1,187 @@
+/**
+ * @file session.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "coronium.hpp"
+#include "../include/coronium/session.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * Session
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * @brief Open the binary file f (see Binary).
+ *
+ * The language of lang is loaded first if it was not already.
+ */
+Session::Session (Coronium& lang, const std::string& f) : coro (lang)
+
+{
+    coro.loadLanguage();
+    trans = coro.trans;
+    auto* binary = new Binary (f, "default");
+    binary->attachToSpace (trans->getDefaultCodeSpace());
+    loader = binary;
+    setup();
+}
+
+/**
+ * @brief Decode a caller-owned buffer (see BinaryRaw).
+ */
+Session::Session (Coronium& lang, const uint1* imgbuffer, uintb imgsize) : coro (lang)
+
+{
+    coro.loadLanguage();
+    trans = coro.trans;
+    auto* raw = new BinaryRaw (imgbuffer, imgsize);
+    raw->attachToSpace (trans->getDefaultCodeSpace());
+    loader = raw;
+    setup();
+}
+
+// --------------------------------------------------------------------------------
+Session::~Session()
+
+{
+    delete decoder;             // before the context it caches
+    delete context;
+    delete loader;
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+ * @brief Give the session its own context, laid out by the spec with the .pspec defaults.
+ */
+auto
+Session::setup() -> void
+
+{
+    context = new ContextInternal();
+    trans->registerContextVariables (context);
+    coro.importContexts (context);
+    decoder = new DecodeContext (*trans, loader, context);
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+auto
+Session::getBinaryImage() const -> Binary*
+
+{
+    return dynamic_cast<Binary*> (loader);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Session::getBinaryRawImage() const -> BinaryRaw*
+
+{
+    return dynamic_cast<BinaryRaw*> (loader);
+}
+
+/**
+ * @brief Same as Coronium::disassemble, on this session's image.
+ */
+auto
+Session::disassemble (Address addr, uint4 ninsns) -> std::vector<Instruction>
+
+{
+    std::vector<Instruction> result;
+    auto arena = std::make_shared<PcodeArena>();
+
+    result.reserve (ninsns);
+    while (result.size() != ninsns) {
+        AssemblyRaw asm_emit;
+        PcodeRaw pcode_emit (coro.pcode_behaviors, arena);
+        int4 length = trans->decode (*decoder, asm_emit, pcode_emit, addr);
+        result.emplace_back (std::move (asm_emit), std::move (pcode_emit), length);
+        addr = addr + length;
+    }
+    return result;
+}
+
+/**
+ * @brief Same as Coronium::dump(Range), on this session's image.
+ */
+auto
+Session::dump (Range rng) -> std::vector<Instruction>
+
+{
+    std::vector<Instruction> result;
+    auto arena = std::make_shared<PcodeArena>();
+
+    Address pos = rng.getFirstAddr ();
+    Address finish = rng.getLastAddr ();
+    while (pos < finish) {
+        AssemblyRaw asm_emit;
+        PcodeRaw pcode_emit (coro.pcode_behaviors, arena);
+        int4 length = trans->decode (*decoder, asm_emit, pcode_emit, pos);
+        result.emplace_back (std::move (asm_emit), std::move (pcode_emit), length);
+        pos = pos + length;
+    }
+    return result;
+}
+
+/**
+ * @brief Same as Coronium::dump(Range, visit), on this session's image.
+ */
+auto
+Session::dump (Range rng, std::function<bool (Instruction const&)> visit) -> Address
+
+{
+    auto arena = std::make_shared<PcodeArena>();
+    Instruction insn (AssemblyRaw(), PcodeRaw (coro.pcode_behaviors, arena), 0);
+
+    Address pos = rng.getFirstAddr ();
+    Address finish = rng.getLastAddr ();
+    while (pos < finish) {
+        arena->clear();
+        insn.pcode.clear();
+        insn.size = trans->decode (*decoder, insn.assembly, insn.pcode, pos);
+        pos = pos + insn.size;
+        if (!visit (insn))
+            break;
+    }
+    return pos;
+}
+
+/**
+ * @brief Same as Coronium::dumpBatch, on this session's image.
+ *
+ * Mnemonic ids are shared with the Coronium and all of its sessions.
+ */
+auto
+Session::dumpBatch (Range rng) -> InstructionBatch
+
+{
+    InstructionBatch batch (coro.mnemonics);
+
+    Address pos = rng.getFirstAddr ();
+    Address finish = rng.getLastAddr ();
+    while (pos < finish)
+        pos = pos + batch.append (*trans, *decoder, pos);
+    return batch;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file sla-pack.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>               // rename(), remove()
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/coronium/sla-pack.hpp"
+
+using namespace coronium;
+
+const char* SlaPack::extension = ".pack";
+
+/*
+ * File layout (host byte order):
+ *
+ *   PackHeader
+ *   uint4 stroffs[nstrings + 1]   offsets of the strings in the blob
+ *   uint4 words[nwords]           elements in pre-order, each one being
+ *                                 name, content, #attributes, #children,
+ *                                 followed by (attribute name, value) pairs
+ *   char  blob[]                  string characters
+ */
+struct PackHeader {
+    char magic[8];
+    uint4 byteorder;
+    uint4 nstrings;
+    uint4 nwords;
+    uint4 reserved;
+    uint8 slasize;              // size of the .sla the pack was made from
+    int8 slamtime;              // mtime (ns) of the .sla the pack was made from
+};
+
+static const char pack_magic[8] = { 'C', 'O', 'R', 'S', 'L', 'A', '1', '\n' };
+static const uint4 pack_byteorder = 0x01020304;
+
+/*
+ *
+ * static functions
+ *
+ */
+static auto
+statSla (const std::string& slafile, uint8& size, int8& mtime) -> bool
+
+{
+    struct stat st;
+    if (stat (slafile.c_str(), &st) != 0)
+        return false;
+    size = st.st_size;
+    mtime = (int8)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+/*
+ *
+ * SlaPack
+ *
+ */
+
+/**
+ * @brief Write the pack of a parsed .sla next to it.
+ *
+ * The pack is written to a temporary file and renamed into place, so concurrent
+ * readers never see a partial pack.
+ *
+ * @param[in] root The \<sleigh> element.
+ * @param[in] slafile Path of the .sla root was parsed from.
+ * @return false if the pack could not be written.
+ */
+auto
+SlaPack::write (const Element* root, const std::string& slafile) -> bool
+
+{
+    PackHeader header;
+    std::unordered_map<std::string, uint4> ids;
+    std::vector<const std::string*> strings;
+    std::vector<uint4> words;
+
+    auto intern = [&] (const std::string& str) -> uint4 {
+        auto res = ids.emplace (str, strings.size());
+        if (res.second)
+            strings.push_back (&res.first->first);
+        return res.first->second;
+    };
+
+    std::vector<const Element*> todo { root };
+    while (!todo.empty()) {
+        const Element* el = todo.back();
+        todo.pop_back();
+        words.push_back (intern (el->getName()));
+        words.push_back (intern (el->getContent()));
+        words.push_back (el->getNumAttributes());
+        words.push_back (el->getChildren().size());
+        for (auto i = 0; i != el->getNumAttributes(); ++i) {
+            words.push_back (intern (el->getAttributeName (i)));
+            words.push_back (intern (el->getAttributeValue (i)));
+        }
+        // Push in reverse so children come out in document order.
+        const List& children = el->getChildren();
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+            todo.push_back (*it);
+    }
+
+    std::vector<uint4> stroffs;
+    uint4 off = 0;
+    for (auto str : strings) {
+        stroffs.push_back (off);
+        off += str->length();
+    }
+    stroffs.push_back (off);
+
+    memcpy (header.magic, pack_magic, sizeof (pack_magic));
+    header.byteorder = pack_byteorder;
+    header.nstrings = strings.size();
+    header.nwords = words.size();
+    header.reserved = 0;
+    if (!statSla (slafile, header.slasize, header.slamtime))
+        return false;
+
+    std::string packfile = slafile + extension;
+    std::string tmpfile = packfile + ".tmp" + std::to_string (getpid());
+    {
+        std::ofstream out (tmpfile, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write ((const char*)&header, sizeof (header));
+        out.write ((const char*)stroffs.data(), stroffs.size() * sizeof (uint4));
+        out.write ((const char*)words.data(), words.size() * sizeof (uint4));
+        for (auto str : strings)
+            out.write (str->data(), str->length());
+        if (!out) {
+            remove (tmpfile.c_str());
+            return false;
+        }
+    }
+    return rename (tmpfile.c_str(), packfile.c_str()) == 0;
+}
+
+/**
+ * @brief mmap the pack of slafile and rebuild its DOM.
+ *
+ * @param[in] slafile Path of the .sla (the pack is slafile + extension).
+ * @return The document (owned by the caller), or nullptr if there is no valid pack.
+ */
+auto
+SlaPack::read (const std::string& slafile) -> Document*
+
+{
+    uint8 slasize;
+    int8 slamtime;
+    if (!statSla (slafile, slasize, slamtime))
+        return nullptr;
+
+    std::string packfile = slafile + extension;
+    int fd = open (packfile.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat (fd, &st) != 0 || (size_t)st.st_size < sizeof (PackHeader)) {
+        close (fd);
+        return nullptr;
+    }
+    size_t mapsize = st.st_size;
+    void* map = mmap (nullptr, mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+        return nullptr;
+
+    const char* base = (const char*)map;
+    PackHeader header;
+    memcpy (&header, base, sizeof (header));
+    size_t tables = sizeof (header) + ((size_t)header.nstrings + 1 + header.nwords) * sizeof (uint4);
+    if (memcmp (header.magic, pack_magic, sizeof (pack_magic)) != 0 ||
+        header.byteorder != pack_byteorder ||
+        header.slasize != slasize || header.slamtime != slamtime || tables > mapsize)
+    {
+        munmap (map, mapsize);
+        return nullptr;
+    }
+    const uint4* stroffs = (const uint4*)(base + sizeof (header));
+    const uint4* words = stroffs + header.nstrings + 1;
+    const char* blob = (const char*)(words + header.nwords);
+    if (tables + stroffs[header.nstrings] > mapsize) {
+        munmap (map, mapsize);
+        return nullptr;
+    }
+
+    std::vector<std::string> strings (header.nstrings);
+    for (uint4 i = 0; i != header.nstrings; ++i)
+        strings[i].assign (blob + stroffs[i], stroffs[i + 1] - stroffs[i]);
+
+    // Rebuild the tree. Each stack entry is an element still waiting for children.
+    Document* doc = new Document();
+    std::vector<std::pair<Element*, uint4>> stack { { doc, 1 } };
+    uint4 w = 0;
+    bool ok = true;
+    while (!stack.empty()) {
+        if (stack.back().second == 0) {
+            stack.pop_back();
+            continue;
+        }
+        if (w + 4 > header.nwords) {
+            ok = false;
+            break;
+        }
+        stack.back().second -= 1;
+        Element* parent = stack.back().first;
+        Element* el = new Element (parent);
+        parent->addChild (el);
+
+        uint4 name = words[w++], content = words[w++];
+        uint4 nattr = words[w++], nchildren = words[w++];
+        if (name >= header.nstrings || content >= header.nstrings || w + 2 * nattr > header.nwords) {
+            ok = false;
+            break;
+        }
+        el->setName (strings[name]);
+        const std::string& text = strings[content];
+        if (!text.empty())
+            el->addContent (text.data(), 0, text.length());
+        for (uint4 i = 0; i != nattr; ++i, w += 2) {
+            if (words[w] >= header.nstrings || words[w + 1] >= header.nstrings) {
+                ok = false;
+                break;
+            }
+            el->addAttribute (strings[words[w]], strings[words[w + 1]]);
+        }
+        if (!ok)
+            break;
+        stack.emplace_back (el, nchildren);
+    }
+    munmap (map, mapsize);
+    if (!ok) {
+        delete doc;
+        return nullptr;
+    }
+    return doc;
+}
+
+/**
+ * @brief Load the DOM of a .sla, preferring its pack.
+ *
+ * When no valid pack exists the .sla is parsed as XML and a pack is written for next
+ * time (best effort, the directory may be read-only).
+ *
+ * @param[in] slafile Path of the .sla.
+ * @return The document (owned by the caller).
+ */
+auto
+SlaPack::load (const std::string& slafile) -> Document*
+
+{
+    Document* doc = read (slafile);
+    if (doc)
+        return doc;
+
+    std::ifstream s (slafile);
+    if (!s)
+        throw XmlError ("Unable to open xml document " + slafile);
+    doc = xml_tree (s);
+    write (doc->getRoot(), slafile);
+    return doc;
+}
@@ -0,0 +1,923 @@
+/**
+ * @file translator.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "../include/coronium/translator.hpp"
+#include "../include/coronium/binary-image.hpp"
+
+using namespace coronium;
+
+/*
+ *
+ * static functions
+ *
+ */
+
+/**
+ * @brief Whether a constructor of the spec weaves in the pcode of another instruction.
+ *
+ * SleighBuilder looks a crossbuilt instruction up in the DisassemblyCache, so such specs
+ * cannot keep their parses in a ParserCache.
+ */
+static auto
+hasCrossBuild (SymbolTable& symtab, int4 numsections) -> bool
+
+{
+    SymbolScope* scope = symtab.getGlobalScope();
+    for (auto it = scope->begin(); it != scope->end(); ++it) {
+        if ((*it)->getType() != SleighSymbol::subtable_symbol)
+            continue;
+        auto sub = (SubtableSymbol*)*it;
+        for (int4 i = 0; i != sub->getNumConstructors(); ++i) {
+            Constructor* ct = sub->getConstructor (i);
+            for (int4 sec = -1; sec < numsections; ++sec) {
+                ConstructTpl* templ = (sec < 0) ? ct->getTempl() : ct->getNamedTempl (sec);
+                if (templ == (ConstructTpl*)0)
+                    continue;
+                for (auto op : templ->getOpvec())
+                    if (op->getOpcode() == CROSSBUILD)
+                        return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Constructors of the spec that commit context (globalset).
+ *
+ * Constructor does not expose its context changes, they are read from the <commit>
+ * elements of the <sleigh> element the spec was restored from.
+ */
+static auto
+findCommits (const Element* sleigh, const SymbolTable& symtab) -> std::unordered_set<const Constructor*>
+
+{
+    std::unordered_set<const Constructor*> res;
+    for (auto* table : sleigh->getChildren()) {
+        if (table->getName() != "symbol_table")
+            continue;
+        for (auto* el : table->getChildren()) {
+            if (el->getName() != "subtable_sym")
+                continue;
+            uintm id = std::stoul (el->getAttributeValue ("id"), nullptr, 0);
+            auto* sub = dynamic_cast<SubtableSymbol*> (symtab.findSymbol (id));
+            if (sub == nullptr)
+                continue;
+            int4 index = 0;     // constructors are restored in document order
+            for (auto* child : el->getChildren()) {
+                if (child->getName() != "constructor")
+                    continue;
+                for (auto* op : child->getChildren()) {
+                    if (op->getName() == "commit") {
+                        res.insert (sub->getConstructor (index));
+                        break;
+                    }
+                }
+                index += 1;
+            }
+        }
+    }
+    return res;
+}
+
+/*
+ *
+ * DecodeStats
+ *
+ */
+auto
+DecodeStats::operator+= (const DecodeStats& other) -> DecodeStats&
+
+{
+    for (int4 i = 0; i != NUM_STAGES; ++i) {
+        cycles[i] += other.cycles[i];
+        calls[i] += other.calls[i];
+    }
+    cache_hits += other.cache_hits;
+    cache_misses += other.cache_misses;
+    cache_evictions += other.cache_evictions;
+    loadfill_bytes += other.loadfill_bytes;
+    return *this;
+}
+
+// --------------------------------------------------------------------------------
+auto
+DecodeStats::getStageName (Stage stage) -> const char*
+
+{
+    static const char* names[NUM_STAGES] = {
+        "loadFill", "resolve", "resolveHandles", "build pcode", "emit"
+    };
+    return names[stage];
+}
+
+/**
+ * @return true if the library was built to fill in the counters (CORONIUM_STATS).
+ */
+auto
+DecodeStats::isEnabled() -> bool
+
+{
+#ifdef CORO_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * DecodeContext
+ *
+ */
+DecodeContext::DecodeContext (const Translator& trans, LoadImage* ld, ContextDatabase* c_db)
+    : owner (trans), ctxcache (c_db)
+
+{
+    loader = ld;
+    rawimage = dynamic_cast<BinaryRaw*> (ld);
+    binimage = dynamic_cast<Binary*> (ld);
+    imagegen = imageGeneration();
+    createCaches();
+}
+
+DecodeContext::~DecodeContext()
+
+{
+    delete discache;
+    if (parsers)
+        delete parsers;
+    delete contexts;
+#ifdef CORO_STATS
+    std::lock_guard<std::mutex> guard (owner.statslock);
+    owner.retired += stats;
+#endif
+}
+
+/**
+ * @brief Create the parser caches with the sizes currently set on the Translator.
+ *
+ * A ParserCache of the right size is only cleared, its parses are costly to allocate.
+ */
+auto
+DecodeContext::createCaches() -> void
+
+{
+    discache = new DisassemblyCache (&ctxcache, owner.getConstantSpace(),
+                                     owner.parser_cachesize, owner.parser_windowsize);
+    ringfills = 0;
+    if (contexts && (contexts->getSize() == owner.contextcache_size))
+        contexts->invalidate();
+    else {
+        delete contexts;
+        contexts = new ContextRegionCache (ctxcache.getDatabase(), owner.contextcache_size);
+    }
+    bool wanted = (owner.parsercache_size > 0) && !owner.crossbuild;
+    if (parsers && wanted && (parsers->getSize() == owner.parsercache_size) &&
+        (parsers->getWindowSize() == owner.parsercache_windowsize)) {
+        parsers->clear();
+        return;
+    }
+    if (parsers)
+        delete parsers;
+    parsers = nullptr;
+    if (wanted)
+        parsers = new ParserCache (&ctxcache, owner.getConstantSpace(), owner.parsercache_size,
+                                   owner.parsercache_windowsize);
+}
+
+/**
+ * @return getGeneration() of a BinaryRaw or Binary loader, else 0.
+ */
+auto
+DecodeContext::imageGeneration() const -> uint4
+
+{
+    if (rawimage)
+        return rawimage->getGeneration();
+    return binimage ? binimage->getGeneration() : 0;
+}
+
+/**
+ * @brief Drop the window and the cached parses if the image changed since they were made.
+ *
+ * Catches patches, rebasing and new regions made on the loader itself rather than
+ * through Coronium. Changes to other loaders still need flushParsers().
+ */
+auto
+DecodeContext::checkImage() -> void
+
+{
+    if (imageGeneration() != imagegen)
+        flushParsers();
+}
+
+/**
+ * @brief Load the bytes of the window from addr on.
+ *
+ * The window never extends past the region (section) holding addr: past it, loadFill
+ * pads with zeroes but throws for a read starting there. Only a BinaryRaw or a mapped
+ * Binary report their regions, other loaders are read 16 bytes at a time.
+ *
+ * @return false if fewer than 16 bytes of the region are left at addr.
+ */
+auto
+DecodeContext::fillWindow (const Address& addr) -> bool
+
+{
+    windowstart = Address();
+    windowfill = 0;
+    uintb extent = rawimage ? rawimage->getExtent (addr) : binimage->getExtent (addr);
+    if (extent < 16)
+        return false;
+    int4 size = (int4)std::min (extent, (uintb)owner.bytewindow_size);
+    if (bytewindow.size() < (size_t)size)
+        bytewindow.resize (owner.bytewindow_size);
+    loader->loadFill (bytewindow.data(), size, addr);
+    CORO_COUNT (stats.loadfill_bytes += size);
+    windowstart = addr;
+    windowfill = size;
+    return true;
+}
+
+/**
+ * @brief Copy the 16 bytes at addr into ptr, the same bytes loadFill would give.
+ *
+ * Sequential decoding is served out of the window, the loader is only called when
+ * addr + 16 is past it.
+ */
+auto
+DecodeContext::fetchBytes (uint1* ptr, const Address& addr) -> void
+
+{
+    if ((owner.bytewindow_size != 0) && (rawimage || binimage)) {
+        uintb off = addr.getOffset() - windowstart.getOffset();
+        if ((addr.getSpace() == windowstart.getSpace()) && (off < (uintb)windowfill) &&
+            ((uintb)windowfill - off >= 16)) {
+            memcpy (ptr, bytewindow.data() + off, 16);
+            return;
+        }
+        if (fillWindow (addr)) {
+            memcpy (ptr, bytewindow.data(), 16);
+            return;
+        }
+    }
+    loader->loadFill (ptr, 16, addr);
+    CORO_COUNT (stats.loadfill_bytes += 16);
+}
+
+/**
+ * @brief Whether a parse was resolved under a context other than the current one.
+ *
+ * Parses without a recorded context (made while not tracking) count as stale.
+ */
+auto
+DecodeContext::isStale (const ParserContext& pos) -> bool
+
+{
+    auto it = parsedcontext.find (&pos);
+    if (it == parsedcontext.end())
+        return true;
+    curcontext.resize (it->second.size());
+    contexts->getContext (pos.getAddr(), curcontext.data());
+    return curcontext != it->second;
+}
+
+/**
+ * @brief pos.applyCommits(), dropping the cached context regions if it changed any.
+ *
+ * Where a commit lands is only known inside ParserContext, so every region is dropped
+ * after a parse whose constructors have a globalset.
+ */
+auto
+DecodeContext::applyCommits (ParserContext& pos) -> void
+
+{
+    pos.applyCommits();
+    if (allowset && !committers.empty() && (committers.find (&pos) != committers.end()))
+        contexts->invalidate();
+}
+
+// --------------------------------------------------------------------------------
+auto
+DecodeContext::allowContextSet (bool val) -> void
+
+{
+    allowset = val;
+    ctxcache.allowSet (val);
+}
+
+/**
+ * @brief Check cached parses against the ContextDatabase before reusing them.
+ *
+ * Costs a copy of the context words per resolve and a comparison per reused parse.
+ */
+auto
+DecodeContext::trackContext (bool val) -> void
+
+{
+    trackcontext = val;
+    parsedcontext.clear();
+}
+
+/**
+ * @brief Drop every cached parse, e.g. after the bytes of the image changed.
+ *
+ * The DisassemblyCache has no way to drop single entries, it is small enough to be
+ * rebuilt. The cached context blob and the prefetched bytes are dropped as well, so
+ * changes made to the ContextDatabase or the image directly are seen by the next
+ * decode. Cache sizes changed on the Translator take effect here.
+ */
+auto
+DecodeContext::flushParsers() -> void
+
+{
+    delete discache;
+    ctxcache = ContextCache (ctxcache.getDatabase());
+    ctxcache.allowSet (allowset);
+    createCaches();
+    parsedcontext.clear();
+    committers.clear();
+    windowstart = Address();
+    windowfill = 0;
+    imagegen = imageGeneration();
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * RegisterNames
+ *
+ */
+RegisterNames::RegisterNames (const Translate& t) : trans (&t)
+
+{
+    std::map<VarnodeData, std::string> reglist;
+    trans->getAllRegisters (reglist);
+    names.reserve (reglist.size());
+    for (auto& reg : reglist)
+        names.emplace (Key { reg.first.space, reg.first.offset, (int4)reg.first.size }, reg.second);
+}
+
+/**
+ * @brief Same answer as Translate::getRegisterName ("" if no register covers the varnode).
+ */
+auto
+RegisterNames::lookup (AddrSpace* space, uintb offset, int4 size) const -> const std::string&
+
+{
+    Key key { space, offset, size };
+    auto it = names.find (key);
+    if (it != names.end())
+        return it->second;
+
+    std::lock_guard<std::mutex> guard (lock);
+    auto found = derived.find (key);
+    if (found == derived.end())
+        found = derived.emplace (key, trans->getRegisterName (space, offset, size)).first;
+    return found->second; // nodes of an unordered_map never move
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Translator
+ *
+ */
+
+// CONSTRUCTORS/DESTRUCTORS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+Translator::Translator (LoadImage* ld, ContextDatabase* c_db) : Sleigh (ld, c_db)
+
+{
+    loader = ld;
+    context_db = c_db;
+}
+
+Translator::~Translator()
+
+{
+    if (maincontext)
+        delete maincontext;
+    if (regnames)
+        delete regnames;
+    if (decisions)
+        delete decisions;
+}
+
+// PRIVATE METHODS ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/**
+ * @brief Copy of Sleigh::resolve reading bytes through the given DecodeContext.
+ *
+ * The 16 instruction bytes come out of the DecodeContext's byte window instead of a
+ * loadFill per instruction.
+ *
+ * @param[in] ctx Supplies the LoadImage.
+ * @param[in,out] pos The parse object that will hold the resulting tree.
+ */
+auto
+Translator::resolve (DecodeContext& ctx, ParserContext& pos) const -> void
+
+{
+    {
+        CORO_STAGE (ctx.stats, LOADFILL);
+        ctx.fetchBytes (pos.getBuffer(), pos.getAddr());
+    }
+    CORO_STAGE (ctx.stats, RESOLVE);
+    ParserWalkerChange walker (&pos);
+    pos.deallocateState (walker); // Clear the previous resolve and initialize the walker
+    Constructor *ct, *subct;
+    uint4 off;
+    int4 oper, numoper;
+
+    pos.setDelaySlot (0);
+    walker.setOffset (0);       // Initial offset
+    pos.clearCommits();         // Clear any old context commits
+    // Get context for current address (pos.loadContext() through the region cache)
+    const uintm* context = ctx.contexts->lookup (pos.getAddr());
+    int4 contextsize = ctx.contexts->getDatabase()->getContextSize();
+    for (int4 i = 0; i < contextsize; ++i)
+        pos.setContextWord (i, context[i], ~(uintm)0);
+    if (ctx.trackcontext)
+        ctx.parsedcontext[&pos].assign (context, context + contextsize);
+    bool findcommits = !committing.empty();
+    ct = resolveSymbol (root, walker, pos); // Base constructor
+    bool commits = findcommits && (committing.find (ct) != committing.end());
+    walker.setConstructor (ct);
+    ct->applyContext (walker);
+    while (walker.isState()) {
+        ct = walker.getConstructor();
+        oper = walker.getOperand();
+        numoper = ct->getNumOperands();
+        while (oper < numoper) {
+            OperandSymbol* sym = ct->getOperand (oper);
+            off = walker.getOffset (sym->getOffsetBase()) + sym->getRelativeOffset();
+            pos.allocateOperand (oper, walker); // Descend into new operand and reserve space
+            walker.setOffset (off);
+            TripleSymbol* tsym = sym->getDefiningSymbol();
+            if (tsym != (TripleSymbol*)0) {
+                subct = resolveSymbol (tsym, walker, pos);
+                if (subct != (Constructor*)0) {
+                    if (findcommits && !commits)
+                        commits = (committing.find (subct) != committing.end());
+                    walker.setConstructor (subct);
+                    subct->applyContext (walker);
+                    break;
+                }
+            }
+            walker.setCurrentLength (sym->getMinimumLength());
+            walker.popOperand();
+            oper += 1;
+        }
+        if (oper >= numoper) {  // Finished processing constructor
+            walker.calcCurrentLength (ct->getMinimumLength(), numoper);
+            walker.popOperand();
+            // Check for use of delayslot
+            ConstructTpl* templ = ct->getTempl();
+            if ((templ != (ConstructTpl*)0) && (templ->delaySlot() > 0))
+                pos.setDelaySlot (templ->delaySlot());
+        }
+    }
+    pos.setNaddr (pos.getAddr() + pos.getLength()); // Update Naddr to pointer after instruction
+    pos.setParserState (ParserContext::disassembly);
+    if (commits)
+        ctx.committers.insert (&pos);
+    else if (findcommits)
+        ctx.committers.erase (&pos);
+}
+
+/**
+ * @brief sym->resolve(walker), through the DecisionTable for subtables.
+ */
+auto
+Translator::resolveSymbol (TripleSymbol* sym, ParserWalker& walker, ParserContext& pos) const -> Constructor*
+
+{
+    int4 root = (use_decisions && decisions) ? decisions->getRoot (sym->getId()) : -1;
+    if (root < 0)
+        return sym->resolve (walker);
+    return decisions->resolve (root, walker, pos.getBuffer());
+}
+
+/**
+ * @brief Mirror of Sleigh::obtainContext operating on the given DecodeContext.
+ *
+ * @param[in] ctx Decoding state to use.
+ * @param[in] addr Address of the instruction.
+ * @param[in] state ParserContext::disassembly or ParserContext::pcode.
+ * @param[in] delayslot The parse is for a delay slot, which SleighBuilder looks up in the
+ *            DisassemblyCache, so it must not come from the ParserCache.
+ * @return The (possibly cached) parse tree for the instruction at addr.
+ */
+auto
+Translator::getParser (DecodeContext& ctx, const Address& addr, int4 state, bool delayslot) const
+    -> ParserContext*
+
+{
+    ParserContext* pos;
+    ctx.checkImage();
+    if (ctx.parsers && !delayslot) {
+        pos = ctx.parsers->lookup (addr);
+        if (pos == nullptr) {
+            bool evicted;
+            pos = ctx.parsers->insert (addr, evicted);
+            CORO_COUNT (ctx.stats.cache_evictions += evicted);
+        }
+    } else {
+        pos = ctx.discache->getParserContext (addr);
+        if (pos->getParserState() == ParserContext::uninitialized) {
+            // The ring of the DisassemblyCache is reused in order once every slot was used.
+            CORO_COUNT ((ctx.ringfills < (uint8)parser_cachesize ? ctx.ringfills : ctx.stats.cache_evictions) += 1);
+        }
+    }
+    int4 curstate = pos->getParserState();
+    if (ctx.trackcontext && curstate != ParserContext::uninitialized && ctx.isStale (*pos))
+        curstate = ParserContext::uninitialized;
+    CORO_COUNT ((curstate == ParserContext::uninitialized ? ctx.stats.cache_misses : ctx.stats.cache_hits) += 1);
+    if (curstate >= state)
+        return pos;
+    if (curstate == ParserContext::uninitialized) {
+        resolve (ctx, *pos);
+        if (state == ParserContext::disassembly)
+            return pos;
+    }
+    CORO_STAGE (ctx.stats, RESOLVE_HANDLES);
+    resolveHandles (*pos);
+    return pos;
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::emitAssembly (AssemblyEmit& emit, ParserContext* pos, const Address& addr) const -> void
+
+{
+    ParserWalker walker (pos);
+    walker.baseState();
+
+    Constructor* ct = walker.getConstructor();
+    std::ostringstream mons;
+    ct->printMnemonic (mons, walker);
+    std::ostringstream body;
+    ct->printBody (body, walker);
+    emit.dump (addr, mons.str(), body.str());
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::emitPcode (DecodeContext& ctx, PcodeEmit& emit, ParserContext* pos, const Address& addr) const -> int4
+
+{
+    ctx.applyCommits (*pos);
+    int4 fallOffset = pos->getLength();
+
+    if (pos->getDelaySlot() > 0) {
+        int4 bytecount = 0;
+        do {
+            // Do not use pos->getNaddr(), a cached pos may have had its naddr adjusted.
+            ParserContext* delaypos = getParser (ctx, pos->getAddr() + fallOffset, ParserContext::pcode, true);
+            ctx.applyCommits (*delaypos);
+            int4 len = delaypos->getLength();
+            fallOffset += len;
+            bytecount += len;
+        } while (bytecount < pos->getDelaySlot());
+        pos->setNaddr (pos->getAddr() + fallOffset);
+    }
+    ParserWalker walker (pos);
+    walker.baseState();
+    ctx.pcode_cache.clear();
+    SleighBuilder builder (&walker, ctx.discache, &ctx.pcode_cache, getConstantSpace(), getUniqueSpace(),
+                           unique_allocatemask);
+    try {
+        {
+            CORO_STAGE (ctx.stats, BUILD_PCODE);
+            builder.build (walker.getConstructor()->getTempl(), -1);
+            ctx.pcode_cache.resolveRelatives();
+        }
+        CORO_STAGE (ctx.stats, EMIT);
+        ctx.pcode_cache.emit (addr, &emit);
+    } catch (UnimplError& err) {
+        std::ostringstream s;
+        s << "Instruction not implemented in pcode:\n ";
+        ParserWalker* cur = builder.getCurrentWalker();
+        cur->baseState();
+        Constructor* ct = cur->getConstructor();
+        cur->getAddr().printRaw (s);
+        s << ": ";
+        ct->printMnemonic (s, *cur);
+        s << "  ";
+        ct->printBody (s, *cur);
+        err.explain = s.str();
+        err.instruction_length = fallOffset;
+        throw err;
+    }
+    return fallOffset;
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::checkAlignment (const Address& addr) const -> void
+
+{
+    if ((alignment != 1) && ((addr.getOffset() % alignment) != 0)) {
+        std::ostringstream s;
+        s << "Instruction address not aligned: " << addr;
+        throw UnimplError (s.str(), 0);
+    }
+}
+
+// PUBLIC METHODS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+auto
+Translator::initialize (DocumentStorage& store) -> void
+
+{
+    Sleigh::initialize (store);
+    // Sleigh::reset frees the DisassemblyCache Sleigh::initialize just made (and
+    // Sleigh's ContextCache, leaving an empty one), DecodeContexts have their own.
+    Sleigh::reset (loader, context_db);
+    const Element* el = store.getTag ("sleigh");
+    if (el) {
+        if (decisions)
+            delete decisions;
+        decisions = new DecisionTable (el, symtab);
+    }
+    crossbuild = hasCrossBuild (symtab, numSections);
+    committing.clear();
+    if (el)
+        committing = findCommits (el, symtab);
+
+    // Same sizing rules as Sleigh::initialize.
+    if ((maxdelayslotbytes > 1) || (unique_allocatemask != 0)) {
+        parser_cachesize = 8;
+        parser_windowsize = 256;
+    }
+    if (maincontext)
+        delete maincontext;
+    maincontext = new DecodeContext (*this, loader, context_db);
+    if (regnames)
+        delete regnames;
+    regnames = new RegisterNames (*this);
+}
+
+/**
+ * @brief Decode another program (image and context) with the loaded spec.
+ *
+ * Hides Sleigh::reset, which would leave the DecodeContext reading the old image and
+ * context. The main DecodeContext is rebuilt, other DecodeContexts keep reading what
+ * they were created with.
+ */
+auto
+Translator::reset (LoadImage* ld, ContextDatabase* c_db) -> void
+
+{
+    Sleigh::reset (ld, c_db);
+    loader = ld;
+    context_db = c_db;
+    if (maincontext) {
+        delete maincontext;
+        maincontext = new DecodeContext (*this, loader, context_db);
+    }
+}
+
+/**
+ * @brief Size the DisassemblyCache of every DecodeContext.
+ *
+ * Sleigh keeps 2 parses in a 32 slot window, 8 parses in 256 slots for specs with delay
+ * slots or unique allocation masks. The main DecodeContext is flushed right away, other
+ * DecodeContexts pick the sizes up when created or flushed.
+ *
+ * @param[in] cachesize Number of parses kept, at least what Sleigh would use.
+ * @param[in] windowsize Number of hash slots, a power of 2.
+ */
+auto
+Translator::setDisassemblyCacheSize (int4 cachesize, int4 windowsize) -> void
+
+{
+    int4 minimum = ((maxdelayslotbytes > 1) || (unique_allocatemask != 0)) ? 8 : 2;
+    if (cachesize < minimum)
+        throw LowlevelError ("Disassembly cache needs at least " + std::to_string (minimum) + " entries");
+    if ((windowsize < 1) || ((windowsize & (windowsize - 1)) != 0))
+        throw LowlevelError ("Bad windowsize for disassembly cache");
+    parser_cachesize = cachesize;
+    parser_windowsize = windowsize;
+    if (maincontext)
+        maincontext->flushParsers();
+}
+
+/**
+ * @brief Keep instruction parses in a ParserCache of the given size (0 turns it off).
+ *
+ * Meant for flow following and decompilation, which come back to an address long after
+ * the DisassemblyCache reused its parse. Each cached parse costs a few KB. Delay slots
+ * are still parsed through the DisassemblyCache, and specs with crossbuild directives
+ * never use a ParserCache. Applied like setDisassemblyCacheSize().
+ *
+ * @param[in] size Number of parses kept.
+ * @param[in] windowsize Number of direct-mapped slots in front of them, a power of 2.
+ */
+auto
+Translator::setParserCacheSize (int4 size, int4 windowsize) -> void
+
+{
+    if (size < 0)
+        throw LowlevelError ("Bad size for parser cache");
+    if ((size > 0) && ((windowsize < 1) || ((windowsize & (windowsize - 1)) != 0)))
+        throw LowlevelError ("Bad windowsize for parser cache");
+    parsercache_size = size;
+    parsercache_windowsize = (size > 0) ? windowsize : 0;
+    if (maincontext)
+        maincontext->flushParsers();
+}
+
+/**
+ * @brief Read instruction bytes from the image size bytes at a time (0 turns it off).
+ *
+ * Each DecodeContext keeps the bytes of one window and copies the bytes of the next
+ * instructions out of it. Any change to a BinaryRaw or Binary drops the window (see
+ * getGeneration()), other loaders changed behind a DecodeContext's back need
+ * DecodeContext::flushParsers().
+ *
+ * @param[in] size Window size in bytes, at least 16.
+ */
+auto
+Translator::setByteWindowSize (int4 size) -> void
+
+{
+    if ((size != 0) && (size < 16))
+        throw LowlevelError ("Byte window must hold at least 16 bytes");
+    bytewindow_size = size;
+    if (maincontext)
+        maincontext->flushParsers();
+}
+
+/**
+ * @brief Number of address regions whose context a DecodeContext keeps (8 by default).
+ *
+ * ghidra's ContextCache keeps one. Applied like setDisassemblyCacheSize().
+ */
+auto
+Translator::setContextCacheSize (int4 size) -> void
+
+{
+    if (size < 1)
+        throw LowlevelError ("Bad size for context cache");
+    contextcache_size = size;
+    if (maincontext)
+        maincontext->flushParsers();
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::allowContextSet (bool val) const -> void
+
+{
+    Sleigh::allowContextSet (val);
+    maincontext->allowContextSet (val);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::instructionLength (const Address& baseaddr) const -> int4
+
+{
+    return instructionLength (*maincontext, baseaddr);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::instructionLength (DecodeContext& ctx, const Address& baseaddr) const -> int4
+
+{
+    ParserContext* pos = getParser (ctx, baseaddr, ParserContext::disassembly);
+    return pos->getLength();
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::printAssembly (AssemblyEmit& emit, const Address& baseaddr) const -> int4
+
+{
+    ParserContext* pos = getParser (*maincontext, baseaddr, ParserContext::disassembly);
+    {
+        CORO_STAGE (maincontext->stats, EMIT);
+        emitAssembly (emit, pos, baseaddr);
+    }
+    return pos->getLength();
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::oneInstruction (PcodeEmit& emit, const Address& baseaddr) const -> int4
+
+{
+    return oneInstruction (*maincontext, emit, baseaddr);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::oneInstruction (DecodeContext& ctx, PcodeEmit& emit, const Address& baseaddr) const -> int4
+
+{
+    checkAlignment (baseaddr);
+    ParserContext* pos = getParser (ctx, baseaddr, ParserContext::pcode);
+    return emitPcode (ctx, emit, pos, baseaddr);
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::decode (AssemblyEmit& asm_emit, PcodeEmit& pcode_emit, const Address& baseaddr) const -> int4
+
+{
+    return decode (*maincontext, asm_emit, pcode_emit, baseaddr);
+}
+
+/**
+ * @brief Decode the instruction at baseaddr into both assembly and pcode.
+ *
+ * The instruction is resolved straight into the ParserContext::pcode state, so the
+ * constructor tree is walked once and shared by both emitters. This is what
+ * printAssembly() followed by oneInstruction() would produce.
+ *
+ * @param[in] ctx Decoding state to use (one per thread).
+ * @param[out] asm_emit Receives the mnemonic and body.
+ * @param[out] pcode_emit Receives the pcode ops.
+ * @param[in] baseaddr Address of the instruction.
+ * @return Length of the instruction (including any delay slots).
+ */
+auto
+Translator::decode (DecodeContext& ctx, AssemblyEmit& asm_emit, PcodeEmit& pcode_emit,
+                    const Address& baseaddr) const -> int4
+
+{
+    checkAlignment (baseaddr);
+    ParserContext* pos = getParser (ctx, baseaddr, ParserContext::pcode);
+    {
+        CORO_STAGE (ctx.stats, EMIT);
+        emitAssembly (asm_emit, pos, baseaddr);
+    }
+    return emitPcode (ctx, pcode_emit, pos, baseaddr);
+}
+
+/**
+ * @brief Lay out db's context words like the context_db of this translator.
+ *
+ * Needed by every ContextDatabase used with a DecodeContext of this translator (the
+ * spec only registers its context variables with its own context_db).
+ */
+auto
+Translator::registerContextVariables (ContextDatabase* db) -> void
+
+{
+    SymbolScope* glb = symtab.getGlobalScope();
+    for (auto iter = glb->begin(); iter != glb->end(); ++iter) {
+        if ((*iter)->getType() != SleighSymbol::context_symbol)
+            continue;
+        auto* csym = static_cast<ContextSymbol*> (*iter);
+        auto* field = static_cast<ContextField*> (csym->getPatternValue());
+        db->registerVariable (csym->getName(), field->getStartBit(), field->getEndBit());
+    }
+}
+
+/**
+ * @brief Counters of the main DecodeContext plus those of every destroyed one.
+ *
+ * Take the snapshot while no other thread decodes through the main DecodeContext.
+ */
+auto
+Translator::getStats() const -> DecodeStats
+
+{
+    std::lock_guard<std::mutex> guard (statslock);
+    DecodeStats stats = retired;
+    if (maincontext)
+        stats += maincontext->stats;
+    return stats;
+}
+
+// --------------------------------------------------------------------------------
+auto
+Translator::resetStats() -> void
+
+{
+    std::lock_guard<std::mutex> guard (statslock);
+    retired.reset();
+    if (maincontext)
+        maincontext->stats.reset();
+}
@@ -0,0 +1,103 @@
+/**
+ * @file bench_decode.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Compares printAssembly() + oneInstruction() against the single parse
+ * Translator::decode() over a deterministic pseudo-random byte buffer.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+// Keeps the emitter cost identical (and negligible) for both variants.
+class PcodeCount : public PcodeEmit {
+public:
+    uint4 nops = 0;
+    void dump (const Address& addr, OpCode opc, VarnodeData* outvar, VarnodeData* vars, int4 isize) override
+    {
+        nops += 1;
+    }
+};
+
+// Linear sweep over the whole buffer. Undecodable bytes are skipped by one
+// alignment unit so both variants walk the same sequence of addresses.
+template <typename F>
+static auto sweep (Translator* trans, BinaryRaw* bin, uintb size, F decode_one) -> double
+
+{
+    auto align = trans->getAlignment();
+    auto start = chrono::steady_clock::now();
+    uintb off = 0;
+    while (off < size) {
+        try {
+            off += decode_one (bin->getAddress (off));
+        } catch (LowlevelError& e) {
+            off += align;
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static auto bench (const char* id, vector<uint1>& payload) -> void
+
+{
+    auto coro = Coronium (id);
+    coro.load (payload.data(), payload.size());
+    BinaryRaw* bin = coro.getBinaryRawImage ();
+    bin->setBaseAddress (0x00000000);
+    Translator* trans = coro.getTranslator();
+
+    double two_pass = sweep (trans, bin, payload.size(), [&] (Address addr) {
+        AssemblyRaw asm_emit;
+        PcodeCount pcode_emit;
+        trans->printAssembly (asm_emit, addr);
+        return trans->oneInstruction (pcode_emit, addr);
+    });
+    double one_pass = sweep (trans, bin, payload.size(), [&] (Address addr) {
+        AssemblyRaw asm_emit;
+        PcodeCount pcode_emit;
+        return trans->decode (asm_emit, pcode_emit, addr);
+    });
+
+    cout << id << "\n"
+         << "  printAssembly + oneInstruction: " << two_pass << " s\n"
+         << "  decode:                         " << one_pass << " s\n"
+         << "  speedup:                        " << two_pass / one_pass << "x\n";
+}
+
+int main (int argc, char** argv)
+
+{
+    vector<uint1> payload = corpus::noise (4 * 1024 * 1024);
+
+    bench ("x86:LE:64:default", payload);
+    bench ("ARM:LE:32:v8", payload);
+}
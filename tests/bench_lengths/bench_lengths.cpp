@@ -0,0 +1,83 @@
+/**
+ * @file bench_lengths.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Compares Coronium::dump() against the length-only Coronium::sweepLengths() over a
+ * buffer filled with a repeated, fully decodable code snippet.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+template <typename F>
+static auto timed (F run) -> double
+
+{
+    auto start = chrono::steady_clock::now();
+    run();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static auto bench (const corpus::Snippet& snippet) -> void
+
+{
+    const char* id = snippet.id;
+    vector<uint1> payload = corpus::repeat (snippet, 4 * 1024 * 1024);
+
+    auto coro = Coronium (id);
+    coro.load (payload.data(), payload.size());
+    BinaryRaw* bin = coro.getBinaryRawImage ();
+    bin->setBaseAddress (0x00000000);
+    Range rng = bin->getAddressRange (0, payload.size());
+
+    size_t ndump = 0, nstream = 0, nsweep = 0;
+    double full = timed ([&] { ndump = coro.dump (rng).size(); });
+    double stream = timed ([&] {
+        coro.dump (rng, [&] (Instruction const& i) { nstream += 1; return true; });
+    });
+    double lengths = timed ([&] { nsweep = coro.sweepLengths (rng).count(); });
+
+    cout << id << " (" << ndump << " instructions";
+    if (nstream != ndump || nsweep != ndump)
+        cout << ", MISMATCH: " << nstream << " streamed, " << nsweep << " swept";
+    cout << ")\n"
+         << "  dump:            " << full << " s\n"
+         << "  dump (visitor):  " << stream << " s\n"
+         << "  sweepLengths:    " << lengths << " s\n"
+         << "  speedup:         " << full / lengths << "x (" << stream / lengths << "x)\n";
+}
+
+int main (int argc, char** argv)
+
+{
+    bench (corpus::x86_64);
+    bench (corpus::arm);
+}
@@ -0,0 +1,341 @@
+/**
+ * @file bench_suite.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Decode throughput of every processor (built with -DCORONIUM_BENCHMARKS=ON, run with
+ * 'make bench').
+ *
+ *   coronium-bench [--all] [--size <bytes>] [--reps <n>] [--sla-dir <dir>] [<id>...]
+ *
+ * Without ids, one language per processor directory is measured (--all measures every
+ * language). Each language runs in its own child process and prints one JSON object
+ * per line on stdout:
+ *
+ *   {"id": ..., "corpus_bytes": ..., "instructions": ..., "decode_errors": ...,
+ *    "construct_s": ..., "construct_warm_s": ..., "disassemble_ips": ..., "dump_ips": ...,
+ *    "sweep_ips": ..., "sweep_tree_ips": ..., "sweep_nowindow_ips": ..., "peak_rss_kb": ...}
+ *
+ * The corpus is deterministic: pseudo-random bytes from a fixed seed are swept once and
+ * only the bytes of the instructions that decoded are kept, back to back. Throughputs
+ * are the best of --reps runs. A sweep only matches constructors, sweep_ips measures
+ * constructor resolution through the translator's DecisionTable and sweep_tree_ips
+ * through the decision trees of the spec (Translator::useDecisionTable(false)) and
+ * sweep_nowindow_ips with a loadFill per instruction (Translator::setByteWindowSize(0)).
+ * construct_s is the first Coronium of the language built in the process (spec read
+ * from disk), construct_warm_s the one built again after the corpus.
+ */
+
+#include "coronium.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>       // getrusage
+#include <sys/wait.h>
+#include <unistd.h>             // fork
+#include <vector>
+
+#ifndef CORONIUM_SLA_DIR
+#define CORONIUM_SLA_DIR "/var/coronium"
+#endif
+
+using namespace coronium;
+using namespace std;
+
+struct Options {
+    bool all = false;
+    size_t size = 1 << 20;
+    int reps = 3;
+    string sla_dir;
+    vector<string> ids;
+};
+
+struct Result {
+    size_t corpus_bytes = 0;
+    size_t instructions = 0;
+    size_t decode_errors = 0;
+    double construct = 0;       // first Coronium of the process
+    double construct_warm = 0;
+    double disassemble = 0;     // instructions per second
+    double dump = 0;
+    double sweep = 0;
+    double sweep_tree = 0;
+    double sweep_nowindow = 0;
+};
+
+template <typename F>
+static auto timed (F run) -> double
+
+{
+    auto start = chrono::steady_clock::now();
+    run();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/**
+ * @brief Keep the bytes of the instructions found in pseudo-random data.
+ */
+static auto make_corpus (const string& id, size_t size) -> vector<uint1>
+
+{
+    vector<uint1> noise (size);
+    uint8 state = 0x9e3779b97f4a7c15ULL;
+    for (auto& byte : noise) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        byte = state >> 56;
+    }
+
+    auto coro = Coronium (id);
+    coro.load (noise.data(), noise.size());
+    coro.getBinaryRawImage()->setBaseAddress (0);
+    Translator* trans = coro.getTranslator();
+    AddrSpace* space = trans->getDefaultCodeSpace();
+    int4 align = trans->getAlignment();
+
+    vector<uint1> corpus;
+    corpus.reserve (size);
+    uintb pos = 0;
+    while (pos + 16 < size) {
+        try {
+            uintb length = trans->instructionLength (Address (space, pos));
+            length = min (length, size - pos);
+            corpus.insert (corpus.end(), noise.begin() + pos, noise.begin() + pos + length);
+            pos += length;
+        } catch (LowlevelError& err) {
+            pos += align;
+        }
+    }
+    return corpus;
+}
+
+/**
+ * @brief dump(Range) that steps over bytes that do not decode.
+ */
+static auto dump_all (Coronium& coro, AddrSpace* space, uintb size, size_t& errors) -> size_t
+
+{
+    int4 align = coro.getTranslator()->getAlignment();
+    size_t count = 0;
+    uintb next = 0;
+    while (next < size) {
+        try {
+            coro.dump (Range (space, next, size), [&] (Instruction const& i) {
+                count += 1;
+                next = i.assembly.address.getOffset() + i.size;
+                return true;
+            });
+            break;
+        } catch (LowlevelError& err) {
+            errors += 1;
+            next += align;
+        }
+    }
+    return count;
+}
+
+static auto bench (const string& id, const Options& opts) -> Result
+
+{
+    Result res;
+    unique_ptr<Coronium> coro;
+    vector<uint1> placeholder (16);
+    res.construct = timed ([&] {
+        coro.reset (new Coronium (id));
+        coro->load (placeholder.data(), placeholder.size());
+    });
+    coro.reset();
+
+    vector<uint1> corpus = make_corpus (id, opts.size);
+    res.corpus_bytes = corpus.size();
+    res.construct_warm = timed ([&] {
+        coro.reset (new Coronium (id));
+        coro->load (corpus.data(), corpus.size());
+    });
+    BinaryRaw* bin = coro->getBinaryRawImage();
+    bin->setBaseAddress (0);
+    Range rng = bin->getAddressRange (0, corpus.size());
+    AddrSpace* space = rng.getSpace();
+
+    vector<uintb> starts;
+    for (int r = 0; r != opts.reps; ++r) {
+        double t = timed ([&] { starts = coro->sweepLengths (rng).offsets(); });
+        res.sweep = max (res.sweep, starts.size() / t);
+    }
+    res.instructions = starts.size();
+
+    coro->getTranslator()->useDecisionTable (false);
+    for (int r = 0; r != opts.reps; ++r) {
+        double t = timed ([&] { starts = coro->sweepLengths (rng).offsets(); });
+        res.sweep_tree = max (res.sweep_tree, starts.size() / t);
+    }
+    coro->getTranslator()->useDecisionTable (true);
+
+    int4 window = coro->getTranslator()->getByteWindowSize();
+    coro->getTranslator()->setByteWindowSize (0);
+    for (int r = 0; r != opts.reps; ++r) {
+        double t = timed ([&] { starts = coro->sweepLengths (rng).offsets(); });
+        res.sweep_nowindow = max (res.sweep_nowindow, starts.size() / t);
+    }
+    coro->getTranslator()->setByteWindowSize (window);
+
+    for (int r = 0; r != opts.reps; ++r) {
+        size_t errors = 0, count = 0;
+        double t = timed ([&] { count = dump_all (*coro, space, corpus.size(), errors); });
+        res.dump = max (res.dump, count / t);
+        res.decode_errors = errors;
+    }
+
+    for (int r = 0; r != opts.reps; ++r) {
+        size_t count = 0;
+        double t = timed ([&] {
+            for (auto off : starts) {
+                try {
+                    count += coro->disassemble (Address (space, off)).size();
+                } catch (LowlevelError& err) {}
+            }
+        });
+        res.disassemble = max (res.disassemble, count / t);
+    }
+    return res;
+}
+
+static auto json_string (const string& s) -> string
+
+{
+    string out = "\"";
+    for (char c : s) {
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+/**
+ * @brief Run bench() in a child so peak RSS is that of one language only.
+ */
+static auto run_child (const string& id, const Options& opts) -> void
+
+{
+    cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        ostringstream line;
+        line << "{\"id\": " << json_string (id);
+        try {
+            Result res = bench (id, opts);
+            struct rusage usage;
+            getrusage (RUSAGE_SELF, &usage);
+            line << ", \"corpus_bytes\": " << res.corpus_bytes
+                 << ", \"instructions\": " << res.instructions
+                 << ", \"decode_errors\": " << res.decode_errors
+                 << ", \"construct_s\": " << res.construct
+                 << ", \"construct_warm_s\": " << res.construct_warm
+                 << ", \"disassemble_ips\": " << (uint8)res.disassemble
+                 << ", \"dump_ips\": " << (uint8)res.dump
+                 << ", \"sweep_ips\": " << (uint8)res.sweep
+                 << ", \"sweep_tree_ips\": " << (uint8)res.sweep_tree
+                 << ", \"sweep_nowindow_ips\": " << (uint8)res.sweep_nowindow
+                 << ", \"peak_rss_kb\": " << usage.ru_maxrss << "}";
+        } catch (LowlevelError& err) {
+            line << ", \"error\": " << json_string (err.explain) << "}";
+        } catch (XmlError& err) {
+            line << ", \"error\": " << json_string (err.explain) << "}";
+        }
+        cout << line.str() << endl;
+        _exit (0);
+    }
+    int status = 0;
+    waitpid (pid, &status, 0);
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        cout << "{\"id\": " << json_string (id) << ", \"error\": \"crashed\"}" << endl;
+}
+
+/**
+ * @brief One language per processor directory, preferring little endian ones.
+ */
+static auto default_ids (const Options& opts) -> vector<string>
+
+{
+    auto index = LanguageIndex::get (opts.sla_dir);
+    map<string, string> picks;  // cpu_dir -> id
+    vector<string> ids;
+    for (auto& lang : index->getLanguages()) {
+        auto deprecated = lang.second.ldefs.find ("deprecated");
+        if (deprecated != lang.second.ldefs.end() && deprecated->second == "true")
+            continue;
+        if (opts.all) {
+            ids.push_back (lang.first);
+            continue;
+        }
+        auto& pick = picks[lang.second.cpu_dir];
+        bool little = lang.first.find (":LE:") != string::npos;
+        if (pick.empty() || (little && pick.find (":LE:") == string::npos))
+            pick = lang.first;
+    }
+    for (auto& p : picks)
+        ids.push_back (p.second);
+    return ids;
+}
+
+int main (int argc, char** argv)
+
+{
+    Options opts;
+    const char* env = getenv ("SLA_DIR");
+    opts.sla_dir = env ? env : CORONIUM_SLA_DIR;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--all")
+            opts.all = true;
+        else if (arg == "--size" && i + 1 < argc)
+            opts.size = strtoull (argv[++i], nullptr, 0);
+        else if (arg == "--reps" && i + 1 < argc)
+            opts.reps = max (1, atoi (argv[++i]));
+        else if (arg == "--sla-dir" && i + 1 < argc)
+            opts.sla_dir = argv[++i];
+        else if (arg[0] == '-') {
+            cerr << "usage: " << argv[0] << " [--all] [--size <bytes>] [--reps <n>] [--sla-dir <dir>] [<id>...]\n";
+            return EXIT_FAILURE;
+        } else
+            opts.ids.push_back (arg);
+    }
+    setenv ("SLA_DIR", opts.sla_dir.c_str(), 1); // picked up by Coronium
+
+    vector<string> ids = opts.ids.empty() ? default_ids (opts) : opts.ids;
+    for (auto& id : ids) {
+        cerr << id << "\n";
+        run_child (id, opts);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file byte_window.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Checks the byte window (see Translator::setByteWindowSize) with several window sizes
+ * against a decoder that reads the image 16 bytes at a time:
+ *
+ *   - an instruction cut by the end of a region decodes the zero padding when a gap
+ *     follows the region, and the bytes of the next region when it follows directly;
+ *   - a window filled before the image changed (patch, setBaseAddress, addRegion made
+ *     through the BinaryRaw itself, not through Coronium) is never read again.
+ *
+ * Exits with 1 on the first difference.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+static const int4 window_sizes[] = { 0, 16, 64, 4096 };
+
+/*
+ * A decoder per window size, all over the same bytes. Index 0 reads through loadFill.
+ */
+struct Decoders {
+    vector<unique_ptr<Coronium>> coros;
+
+    Decoders (const char* id, const vector<uint1>& payload)
+    {
+        for (int4 ws : window_sizes) {
+            coros.emplace_back (new Coronium (id));
+            coros.back()->load (payload.data(), payload.size());
+            coros.back()->getTranslator()->setByteWindowSize (ws);
+        }
+    }
+
+    template <typename Change>
+    auto change (Change fn) -> void
+    {
+        for (auto& coro : coros)
+            fn (*coro->getBinaryRawImage());
+    }
+
+    /*
+     * Decodes the instruction at offset with every decoder, it must be the same and
+     * its body must end with body.
+     */
+    auto expect (const string& what, uintb offset, const string& mnemonic,
+                 const string& body) -> bool
+    {
+        for (size_t c = 0; c != coros.size(); ++c) {
+            BinaryRaw* bin = coros[c]->getBinaryRawImage();
+            Instruction insn = coros[c]->disassemble (bin->getAddress (offset)).at (0);
+            const string& got = insn.assembly.body;
+            if (insn.assembly.mnemonic != mnemonic || got.size() < body.size() ||
+                got.compare (got.size() - body.size(), body.size(), body) != 0) {
+                cout << what << ": MISMATCH, window " << window_sizes[c] << " decoded "
+                     << insn.assembly.mnemonic << " " << got << "\n";
+                return false;
+            }
+        }
+        cout << what << ": OK\n";
+        return true;
+    }
+
+    /*
+     * Decodes the instruction at offset with every decoder, it must not be in the
+     * image anymore.
+     */
+    auto expectUnavailable (const string& what, uintb offset) -> bool
+    {
+        for (size_t c = 0; c != coros.size(); ++c) {
+            BinaryRaw* bin = coros[c]->getBinaryRawImage();
+            try {
+                coros[c]->disassemble (bin->getAddress (offset));
+                cout << what << ": MISMATCH, window " << window_sizes[c]
+                     << " decoded bytes that are no longer mapped\n";
+                return false;
+            } catch (DataUnavailError& err) {
+            }
+        }
+        cout << what << ": OK\n";
+        return true;
+    }
+
+    auto check (const string& what, uintb first, uintb last) -> bool
+    {
+        Range rng = coros[0]->getBinaryRawImage()->getAddressRange (first, last);
+        vector<Instruction> want = coros[0]->dump (rng);
+        for (size_t c = 1; c != coros.size(); ++c)
+            if (!corpus::same (what + " (window " + to_string (window_sizes[c]) + ")",
+                               coros[c]->dump (rng), want))
+                return false;
+        cout << what << ": " << want.size() << " instructions OK\n";
+        return true;
+    }
+};
+
+/*
+ * Every window size decodes a buffer of the snippet, patched, rebased and extended,
+ * like a decoder that never kept bytes.
+ */
+static auto differential (const corpus::Snippet& snippet, uintb at,
+                          const vector<uint1>& replacement) -> bool
+
+{
+    vector<uint1> payload = corpus::repeat (snippet, 16 * 1024);
+    uintb size = snippet.bytes.size();
+    uintb usable = payload.size() - size;
+    string id = snippet.id;
+
+    Decoders dec (snippet.id, payload);
+    bool ok = dec.check (id + " initial", 0, usable);
+
+    // Patch a few snippets around the first 4096 bytes and inside the second.
+    for (uintb s : { (uintb)0, 4096 / size, 5000 / size }) {
+        uintb off = s * size + at;
+        dec.change ([&] (BinaryRaw& bin) {
+            bin.patch (bin.getAddress (off), replacement.data(), replacement.size());
+        });
+    }
+    ok = ok && dec.check (id + " patched", 0, usable);
+    dec.change ([&] (BinaryRaw& bin) { bin.setBaseAddress (0x400000); });
+    ok = ok && dec.check (id + " rebased", 0x400000, 0x400000 + usable);
+    dec.change ([&] (BinaryRaw& bin) {
+        bin.addRegion (payload.size(), snippet.bytes.data(), snippet.bytes.size());
+    });
+    return ok && dec.check (id + " extended", 0x400000, 0x400000 + payload.size());
+}
+
+/*
+ * mov eax,imm32 cut after two bytes of its immediate at the end of a region.
+ */
+static auto straddle() -> bool
+
+{
+    vector<uint1> payload = corpus::repeat (corpus::x86_64, 4096);
+    uintb tail = payload.size();
+    payload.insert (payload.end(), { 0xb8, 0x11, 0x22 });
+    const vector<uint1> rest = { 0x33, 0x44, 0xc3 };
+
+    // A gap after the region: the rest of the immediate is zero padding.
+    Decoders gap (corpus::x86_64.id, payload);
+    gap.change ([&] (BinaryRaw& bin) {
+        bin.addRegion (tail + 0x100, rest.data(), rest.size());
+    });
+    bool ok = gap.expect ("straddle into a gap", tail, "MOV", "0x2211");
+    ok = ok && gap.check ("straddle into a gap", 0, tail);
+
+    // The next region right after it: the immediate is completed from there.
+    Decoders next (corpus::x86_64.id, payload);
+    next.change ([&] (BinaryRaw& bin) {
+        bin.addRegion (payload.size(), rest.data(), rest.size());
+    });
+    ok = ok && next.expect ("straddle into the next region", tail, "MOV", "0x44332211");
+    ok = ok && next.expect ("straddle into the next region", tail + 5, "RET", "");
+    return ok && next.check ("straddle into the next region", 0, tail + 5);
+}
+
+/*
+ * The windows are filled from offset 0, then the image changes under them.
+ */
+static auto invalidate() -> bool
+
+{
+    vector<uint1> payload = corpus::repeat (corpus::x86_64, 4096);
+    const uintb at = corpus::x86_64.bytes.size();  // push rbp of the second snippet
+    Decoders dec (corpus::x86_64.id, payload);
+    bool ok = dec.expect ("window filled", 0, "PUSH", "RBP");
+    ok = ok && dec.expect ("window filled", at, "PUSH", "RBP");
+
+    // Same length, same address: only the generation tells the window is stale.
+    const uint1 nop = 0x90;
+    uint4 generation = dec.coros[0]->getBinaryRawImage()->getGeneration();
+    dec.change ([&] (BinaryRaw& bin) { bin.patch (bin.getAddress (at), &nop, 1); });
+    if (dec.coros[0]->getBinaryRawImage()->getGeneration() == generation) {
+        cout << "patch: MISMATCH, the generation did not change\n";
+        return false;
+    }
+    ok = ok && dec.expect ("patched after the window was filled", at, "NOP", "");
+
+    // The window starts at offset 0 of the old base, which is no longer mapped.
+    dec.change ([&] (BinaryRaw& bin) { bin.setBaseAddress (0x400000); });
+    ok = ok && dec.expectUnavailable ("old base after a rebase", at);
+    ok = ok && dec.expect ("new base after a rebase", 0x400000 + at, "NOP", "");
+
+    // A new region right after the last one: the window may now extend into it.
+    dec.change ([&] (BinaryRaw& bin) {
+        bin.addRegion (payload.size(), corpus::x86_64.bytes.data(), 1);
+    });
+    ok = ok && dec.expect ("added region", 0x400000 + payload.size(), "PUSH", "RBP");
+    return ok;
+}
+
+int main (int argc, char** argv)
+
+{
+    bool ok = straddle();
+    ok &= invalidate();
+    // mov rbp,rsp patched to xor eax,eax; nop
+    ok &= differential (corpus::x86_64, 1, { 0x31, 0xc0, 0x90 });
+    // mov r0,#0 patched to mov r0,#1
+    ok &= differential (corpus::arm, 8, { 0x01, 0x00, 0xa0, 0xe3 });
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file corpus.hpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Code shared by the tests and benchmarks: the snippets they decode, the buffers
+ * built from them and the comparison of two decoded instructions.
+ */
+
+#ifndef CORO_TESTS_CORPUS_H
+#define CORO_TESTS_CORPUS_H
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace corpus {
+
+using coronium::Instruction;
+
+/*
+ * A small function that decodes completely, for a language id.
+ */
+struct Snippet {
+    const char* id;
+    std::vector<uint1> bytes;
+};
+
+// push rbp; mov rbp,rsp; sub rsp,0x10; mov [rbp-4],edi; mov eax,[rbp-4];
+// add eax,1; leave; ret; nop dword [rax+rax]
+static const Snippet x86_64 = { "x86:LE:64:default", {
+        0x55, 0x48, 0x89, 0xe5, 0x48, 0x83, 0xec, 0x10, 0x89, 0x7d, 0xfc,
+        0x8b, 0x45, 0xfc, 0x83, 0xc0, 0x01, 0xc9, 0xc3, 0x0f, 0x1f, 0x44, 0x00, 0x00
+    } };
+
+// push {fp,lr}; add fp,sp,#4; mov r0,#0; pop {fp,pc}
+static const Snippet arm = { "ARM:LE:32:v8", {
+        0x00, 0x48, 0x2d, 0xe9, 0x04, 0xb0, 0x8d, 0xe2,
+        0x00, 0x00, 0xa0, 0xe3, 0x00, 0x88, 0xbd, 0xe8
+    } };
+
+/*
+ * As many whole copies of the snippet as fit in size bytes.
+ */
+inline auto repeat (const Snippet& snippet, size_t size) -> std::vector<uint1>
+
+{
+    std::vector<uint1> payload;
+    while (payload.size() + snippet.bytes.size() <= size)
+        payload.insert (payload.end(), snippet.bytes.begin(), snippet.bytes.end());
+    return payload;
+}
+
+/*
+ * Deterministic random bytes (xorshift), so runs are comparable.
+ */
+inline auto noise (size_t size) -> std::vector<uint1>
+
+{
+    std::vector<uint1> payload (size);
+    uint4 x = 0x2545f491;
+    for (auto& b : payload) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        b = x & 0xff;
+    }
+    return payload;
+}
+
+inline auto same (const Instruction& got, const Instruction& want) -> bool
+
+{
+    if (got.assembly.address != want.assembly.address || got.size != want.size ||
+        got.assembly.mnemonic != want.assembly.mnemonic ||
+        got.assembly.body != want.assembly.body || got.pcode.size() != want.pcode.size())
+        return false;
+    for (size_t i = 0; i != got.pcode.size(); ++i)
+        if (got.pcode[i].getOpcode() != want.pcode[i].getOpcode() ||
+            got.pcode[i].numInput() != want.pcode[i].numInput())
+            return false;
+    return true;
+}
+
+/*
+ * Compares two dumps instruction by instruction, printing the first difference.
+ */
+inline auto same (const std::string& what, const std::vector<Instruction>& got,
+                  const std::vector<Instruction>& want) -> bool
+
+{
+    if (got.size() != want.size()) {
+        std::cout << what << ": MISMATCH in instruction count (" << got.size()
+                  << " instead of " << want.size() << ")\n";
+        return false;
+    }
+    for (size_t n = 0; n != got.size(); ++n)
+        if (!same (got[n], want[n])) {
+            std::cout << what << ": MISMATCH at " << std::hex
+                      << want[n].assembly.address.getOffset() << std::dec << "\n";
+            return false;
+        }
+    return true;
+}
+
+} // namespace corpus
+
+#endif // CORO_TESTS_CORPUS_H
@@ -0,0 +1,137 @@
+/**
+ * @file decision_corpus.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Sweeps the deterministic pseudo-random corpus of bench_decode once with the
+ * flattened decision tables (Translator::useDecisionTable(true), the default) and once
+ * with the spec's decision trees, and checks every instruction: length, assembly,
+ * pcode, or the error thrown. Covers x86-64, ARM and Thumb.
+ * Exits with 1 on the first difference.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+// Every op and varnode as text, enough to tell two pcode sequences apart.
+class PcodeText : public PcodeEmit {
+public:
+    ostringstream text;
+    void dump (const Address&, OpCode opc, VarnodeData* outvar, VarnodeData* vars,
+               int4 isize) override
+    {
+        text << get_opname (opc);
+        if (outvar) {
+            varnode (*outvar);
+            text << " =";
+        }
+        for (int4 i = 0; i != isize; ++i)
+            varnode (vars[i]);
+        text << '\n';
+    }
+    void varnode (const VarnodeData& vn)
+    {
+        text << ' ' << vn.space->getName() << ':' << hex << vn.offset << ':' << dec
+             << vn.size;
+    }
+};
+
+/*
+ * The decoding of the instruction at addr as text, or the error it throws.
+ */
+static auto decodeText (Translator* trans, const Address& addr, int4& length) -> string
+
+{
+    AssemblyRaw asm_emit;
+    PcodeText pcode_emit;
+    try {
+        length = trans->decode (asm_emit, pcode_emit, addr);
+    } catch (LowlevelError& err) {
+        length = 0;
+        return "error: " + err.explain;
+    }
+    return asm_emit.mnemonic + ' ' + asm_emit.body + '\n' + pcode_emit.text.str();
+}
+
+static auto compare (const char* id, const char* mode,
+                     const vector<uint1>& payload) -> bool
+
+{
+    string name = mode ? string (id) + " " + mode : string (id);
+    auto table = Coronium (id);
+    auto tree = Coronium (id);
+    table.load (payload.data(), payload.size());
+    tree.load (payload.data(), payload.size());
+    tree.getTranslator()->useDecisionTable (false);
+    if (mode) {
+        Range all = table.getBinaryRawImage()->getAddressRange (0, payload.size() - 1);
+        table.setContext (all, mode, 1);
+        tree.setContext (all, mode, 1);
+    }
+    Translator* trans = tree.getTranslator();
+    BinaryRaw* bin = tree.getBinaryRawImage();
+    int4 align = trans->getAlignment();
+
+    size_t ninsns = 0, nerrors = 0;
+    uintb off = 0;
+    while (off + 16 <= payload.size()) {
+        Address addr = bin->getAddress (off);
+        int4 want_length, got_length;
+        string want = decodeText (trans, addr, want_length);
+        string got = decodeText (table.getTranslator(), addr, got_length);
+        if (got != want || got_length != want_length) {
+            cout << name << ": MISMATCH at " << hex << off << dec << "\n"
+                 << "  tree:  " << want << "\n"
+                 << "  table: " << got << "\n";
+            return false;
+        }
+        if (want_length == 0) {
+            nerrors += 1;
+            off += align;
+        } else {
+            ninsns += 1;
+            off += want_length;
+        }
+    }
+    cout << name << ": " << ninsns << " instructions, " << nerrors << " errors OK\n";
+    return true;
+}
+
+int main (int argc, char** argv)
+
+{
+    vector<uint1> payload = corpus::noise (4 * 1024 * 1024);
+
+    bool ok = true;
+    ok &= compare ("x86:LE:64:default", nullptr, payload);
+    ok &= compare ("ARM:LE:32:v8", nullptr, payload);
+    ok &= compare ("ARM:LE:32:v8", "TMode", payload);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file decision_table.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Builds random subtables (instruction, context and combined patterns at random
+ * offsets), splits them into a DecisionNode tree as the sleigh compiler does, and
+ * checks that DecisionTable::resolve picks the same Constructor (or throws the same
+ * error) as DecisionNode::resolve for random instruction bytes and context. The
+ * Makefile builds it against the scalar, SSE2 and AVX2 matchers.
+ * usage: decision_table [subtables]
+ * Exits with 1 on the first difference.
+ */
+
+#include <coronium/decision-table.hpp>
+#include <coronium/globalcontext.hh>
+#include <coronium/sleigh.hh>
+#include <coronium/slghpattern.hh>
+#include <coronium/slghsymbol.hh>
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace coronium;
+using namespace std;
+
+static mt19937 rng (1);
+
+/*
+ * A mask of a few bits, often only in the first byte (like most opcode fields).
+ */
+static auto randomMask() -> uintm
+
+{
+    uintm mask = 0;
+    int4 nbits = 1 + rng() % 6;
+    for (int4 i = 0; i != nbits; ++i)
+        mask |= (uintm)1 << (rng() % 32);
+    if (rng() % 2)
+        mask &= 0xff000000;
+    return mask ? mask : 0x80000000;
+}
+
+// --------------------------------------------------------------------------------
+static auto randomPattern() -> DisjointPattern*
+
+{
+    uintm m1 = randomMask(), m2 = randomMask();
+    InstructionPattern a (new PatternBlock (rng() % 6, m1, rng() & m1));
+    InstructionPattern b (new PatternBlock (rng() % 14, m2, rng() & m2));
+    Pattern* instr = (rng() % 2) ? a.doAnd (&b, 0) : a.simplifyClone();
+    Pattern* pat = instr;
+    uintm cm = randomMask();
+    switch (rng() % 4) {
+    case 1:
+        delete instr;
+        pat = new ContextPattern (new PatternBlock (0, cm, rng() & cm));
+        break;
+    case 2:
+        pat = new CombinePattern (new ContextPattern (new PatternBlock (0, cm, rng() & cm)),
+                                  (InstructionPattern*)instr);
+        break;
+    }
+    if (pat->alwaysFalse()) {
+        delete pat;
+        pat = new InstructionPattern (true);
+    }
+    return (DisjointPattern*)pat;
+}
+
+static auto check (int4 trial, const AddrSpace* space, const AddrSpace* constspace) -> bool
+
+{
+    SubtableSymbol* sub = new SubtableSymbol ("t");
+    DecisionNode root (nullptr);
+    int4 nconstructors = 2 + rng() % 40;
+    for (int4 i = 0; i != nconstructors; ++i) {
+        Constructor* ct = new Constructor (sub);
+        sub->addConstructor (ct);
+        DisjointPattern* pat = randomPattern();
+        root.addConstructorPair (pat, ct);
+        delete pat;
+    }
+    DecisionProperties props;
+    root.split (props);
+
+    ostringstream xml;
+    xml << "<sleigh><symbol_table><subtable_sym name=\"t\" id=\"0x0\" scope=\"0x0\" numct=\""
+        << nconstructors << "\">";
+    root.saveXml (xml);
+    xml << "</subtable_sym></symbol_table></sleigh>";
+    istringstream in (xml.str());
+    Document* doc = xml_tree (in);
+    SymbolTable symtab;
+    symtab.addScope();
+    symtab.addSymbol (sub);
+    DecisionTable table (doc->getRoot(), symtab);
+    delete doc;
+
+    ContextInternal db;
+    db.registerVariable ("c", 0, 31);
+    ContextCache ccache (&db);
+    ParserContext pos (&ccache);
+    pos.initialize (8, 8, (AddrSpace*)constspace);
+    pos.setAddr (Address ((AddrSpace*)space, 0x1000));
+    pos.loadContext();
+
+    for (int4 k = 0; k != 2000; ++k) {
+        for (int4 i = 0; i != 16; ++i)
+            pos.getBuffer()[i] = rng();
+        pos.setContextWord (0, rng(), ~(uintm)0);
+        ParserWalkerChange walker (&pos);
+        pos.deallocateState (walker);
+        walker.setOffset (rng() % 4);
+
+        Constructor* want = nullptr;
+        Constructor* got = nullptr;
+        string wanterr, goterr;
+        try {
+            want = root.resolve (walker);
+        } catch (BadDataError& err) {
+            wanterr = err.explain;
+        }
+        try {
+            got = table.resolve (table.getRoot (0), walker, pos.getBuffer());
+        } catch (BadDataError& err) {
+            goterr = err.explain;
+        }
+        if (got != want || goterr != wanterr) {
+            cout << "subtable " << trial << ": MISMATCH for input " << k << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main (int argc, char** argv)
+
+{
+    int4 ntrials = (argc > 1) ? atoi (argv[1]) : 20;
+    Sleigh trans (nullptr, nullptr);
+    AddrSpace space (nullptr, &trans, IPTR_PROCESSOR, "ram", 8, 1, 1, 0, 0);
+    AddrSpace constspace (nullptr, &trans, IPTR_CONSTANT, "const", 8, 1, 0, 0, 0);
+
+    for (int4 trial = 0; trial != ntrials; ++trial)
+        if (!check (trial, &space, &constspace))
+            return 1;
+    cout << ntrials << " subtables OK\n";
+    return 0;
+}
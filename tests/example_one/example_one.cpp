@@ -90,6 +90,41 @@ int main (int argc, char** argv)
     }
     cout << "----------------------------------------\n";
 
+    {
+        // Streaming variant: one Instruction is reused for the whole range.
+        auto coro = Coronium ("x86:LE:32:default");
+        coro.load (payload, sizeof (payload));
+        coronium::BinaryRaw* bin = coro.getBinaryRawImage ();
+        bin->setBaseAddress(0x00000000);
+
+        coro.dump (bin->getAddressRange (0, sizeof (payload)), [] (Instruction const& i) {
+            cout << i.assembly.mnemonic << " "
+                 << i.assembly.body
+                 << endl;
+            return i.assembly.mnemonic != "CALL"; // stop early at the first call
+        });
+    }
+    cout << "----------------------------------------\n";
+
+    {
+        // Recursive descent: the basic blocks reachable from the first byte.
+        auto coro = Coronium ("x86:LE:32:default");
+        coro.load (payload, sizeof (payload));
+        coronium::BinaryRaw* bin = coro.getBinaryRawImage ();
+        bin->setBaseAddress(0x00000000);
+
+        FlowGraph flow (coro, bin->getAddressRange (0, sizeof (payload) - 1));
+        flow.addEntry (bin->getAddress (0));
+        flow.run();
+        for (auto& b : flow.getBlocks()) {
+            cout << b.first << ": " << b.second.ninsns << " instruction(s) ->";
+            for (auto& succ : b.second.successors)
+                cout << " " << succ;
+            cout << endl;
+        }
+    }
+    cout << "----------------------------------------\n";
+
     // {
     //     static uint1 tmp[] = { 0x55 };
     //     auto coro = Coronium ("x86:LE:32:default");
@@ -0,0 +1,191 @@
+/**
+ * @file flow_graph.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Builds a FlowGraph over a small x86-64 function calling another one and checks its
+ * blocks, functions and call graph. Then checks that run(1) and run(N) build the same
+ * graph, for the function and for a buffer of random bytes with many entry points.
+ * Exits with 1 on the first difference.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+static const uintb base = 0x1000;
+
+// 1000  push rbp               1012  pop rbp
+// 1001  mov rbp,rsp            1013  ret
+// 1004  call 1015              1014  int3 (never reached)
+// 1009  test eax,eax           1015  xor eax,eax
+// 100b  je 1012                1017  inc eax
+// 100d  call 1015              1019  ret
+static const vector<uint1> code = {
+    0x55, 0x48, 0x89, 0xe5, 0xe8, 0x0c, 0x00, 0x00, 0x00, 0x85, 0xc0, 0x74, 0x05,
+    0xe8, 0x03, 0x00, 0x00, 0x00, 0x5d, 0xc3, 0xcc, 0x31, 0xc0, 0xff, 0xc0, 0xc3
+};
+
+struct Expected {
+    uintb start;
+    uint4 size;
+    uint4 ninsns;
+    vector<uintb> successors;
+    vector<uintb> calls;
+    bool returns;
+};
+
+static auto offsets (const vector<Address>& addrs) -> vector<uintb>
+
+{
+    vector<uintb> result;
+    for (auto& addr : addrs)
+        result.push_back (addr.getOffset());
+    return result;
+}
+
+static auto sameBlock (const BasicBlock& a, const BasicBlock& b) -> bool
+
+{
+    return a.start == b.start && a.size == b.size && a.ninsns == b.ninsns &&
+        a.successors == b.successors && a.calls == b.calls && a.returns == b.returns &&
+        a.indirect == b.indirect;
+}
+
+/*
+ * Everything the graphs expose must be equal.
+ */
+static auto sameGraph (const string& what, const FlowGraph& a, const FlowGraph& b) -> bool
+
+{
+    bool ok = a.numInstructions() == b.numInstructions() && a.getErrors() == b.getErrors() &&
+        a.getBlocks().size() == b.getBlocks().size() &&
+        a.getFunctions().size() == b.getFunctions().size() &&
+        a.getCallGraph() == b.getCallGraph();
+    for (auto ia = a.getBlocks().begin(), ib = b.getBlocks().begin();
+         ok && ia != a.getBlocks().end(); ++ia, ++ib)
+        ok = sameBlock (ia->second, ib->second);
+    for (auto ia = a.getFunctions().begin(), ib = b.getFunctions().begin();
+         ok && ia != a.getFunctions().end(); ++ia, ++ib)
+        ok = ia->second.entry == ib->second.entry && ia->second.blocks == ib->second.blocks &&
+            ia->second.callees == ib->second.callees;
+    if (!ok) {
+        cout << what << ": MISMATCH between run(1) and run(N)\n";
+        return false;
+    }
+    cout << what << ": " << a.numInstructions() << " instructions, " << a.getBlocks().size()
+         << " blocks, same with run(N) OK\n";
+    return true;
+}
+
+static auto known() -> bool
+
+{
+    const Expected want[] = {
+        { 0x1000, 13, 5, { 0x1012, 0x100d }, { 0x1015 }, false },
+        { 0x100d, 5, 1, { 0x1012 }, { 0x1015 }, false },
+        { 0x1012, 2, 2, {}, {}, true },
+        { 0x1015, 5, 3, {}, {}, true },
+    };
+
+    auto coro = Coronium (corpus::x86_64.id);
+    coro.load (code.data(), code.size());
+    BinaryRaw* bin = coro.getBinaryRawImage();
+    bin->setBaseAddress (base);
+    Range bounds = bin->getAddressRange (base, base + code.size() - 1);
+
+    FlowGraph graph (coro, bounds);
+    graph.addEntry (bin->getAddress (base));
+    graph.run (1);
+
+    if (graph.numInstructions() != 11 || !graph.getErrors().empty() ||
+        graph.getBlocks().size() != 4) {
+        cout << "known function: MISMATCH, " << graph.numInstructions() << " instructions in "
+             << graph.getBlocks().size() << " blocks\n";
+        return false;
+    }
+    for (const Expected& w : want) {
+        const BasicBlock* block = graph.getBlock (bin->getAddress (w.start));
+        if (block == nullptr || block->size != w.size || block->ninsns != w.ninsns ||
+            offsets (block->successors) != w.successors || offsets (block->calls) != w.calls ||
+            block->returns != w.returns || block->indirect) {
+            cout << "known function: MISMATCH in the block at " << hex << w.start << dec << "\n";
+            return false;
+        }
+    }
+
+    auto calls = graph.getCallGraph();
+    set<Address> callee { bin->getAddress (0x1015) };
+    const FlowFunction& caller = graph.getFunctions().at (bin->getAddress (base));
+    if (calls.size() != 2 || calls[bin->getAddress (base)] != callee ||
+        !calls[bin->getAddress (0x1015)].empty() ||
+        offsets (caller.blocks) != vector<uintb> { 0x1000, 0x100d, 0x1012 }) {
+        cout << "known function: MISMATCH in the functions or the call graph\n";
+        return false;
+    }
+    cout << "known function: OK\n";
+
+    FlowGraph parallel (coro, bounds);
+    parallel.addEntry (bin->getAddress (base));
+    parallel.run (4);
+    return sameGraph ("known function", graph, parallel);
+}
+
+/*
+ * Random bytes give many short, overlapping paths, decoded by the threads in any
+ * order.
+ */
+static auto noise (uint4 nthreads) -> bool
+
+{
+    vector<uint1> payload = corpus::noise (256 * 1024);
+    auto build = [&] (Coronium& coro, uint4 n) {
+        coro.load (payload.data(), payload.size());
+        BinaryRaw* bin = coro.getBinaryRawImage();
+        bin->setBaseAddress (base);
+        auto graph = unique_ptr<FlowGraph> (
+            new FlowGraph (coro, bin->getAddressRange (base, base + payload.size() - 1)));
+        for (uintb off = 0; off < payload.size(); off += 512)
+            graph->addEntry (bin->getAddress (base + off));
+        graph->run (n);
+        return graph;
+    };
+    auto one = Coronium (corpus::x86_64.id);
+    auto many = Coronium (corpus::x86_64.id);
+    return sameGraph ("random bytes", *build (one, 1), *build (many, nthreads));
+}
+
+int main (int argc, char** argv)
+
+{
+    bool ok = known();
+    ok &= noise (4);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file pcode_roundtrip.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Writes a buffer of code with Coronium::exportPcode(), maps the file back with a
+ * PcodeReader and checks every instruction, op and varnode against Coronium::dump().
+ * Exits with 1 on the first difference.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <cstdio>
+#include <unistd.h>             // getpid
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+static auto same (const PcodeReader& reader, const PcodeReader::Varnode& vn,
+                  const VarnodeData& vdata) -> bool
+
+{
+    if (reader.getSpaceName (vn.space).str() != vdata.space->getName() ||
+        vn.offset != vdata.offset || vn.size != vdata.size)
+        return false;
+    if (vdata.space->getName() != "register")
+        return true;
+    const PcodeReader::Text* name = reader.getRegisterName (vn);
+    const Translate* trans = vdata.space->getTrans();
+    return name && name->str() == trans->getRegisterName (vdata.space, vdata.offset, vdata.size);
+}
+
+static auto check (const PcodeReader& reader, const PcodeReader::Insn& got,
+                   const Instruction& want) -> bool
+
+{
+    if (reader.getSpaceName (got.space).str() != want.assembly.address.getSpace()->getName() ||
+        got.offset != want.assembly.address.getOffset() || got.length != (uint4)want.size ||
+        got.getMnemonic().str() != want.assembly.mnemonic || got.body.str() != want.assembly.body ||
+        got.nops != want.pcode.size())
+        return false;
+
+    bool ok = true;
+    uint4 i = 0;
+    got.forEachOp ([&] (const PcodeReader::Op& op) {
+        PcodeOpRef ref = want.pcode[i++];
+        if (op.opcode != ref.getOpcode() || (int4)op.ninputs != ref.numInput() ||
+            op.has_output != (ref.getOutput() != nullptr)) {
+            ok = false;
+            return;
+        }
+        if (op.has_output && !same (reader, *op.getOutput(), *ref.getOutput()))
+            ok = false;
+        for (uint4 j = 0; j != op.ninputs; ++j)
+            if (!same (reader, op.getInput (j), *ref.getInput (j)))
+                ok = false;
+    });
+    return ok;
+}
+
+static auto roundtrip (const corpus::Snippet& snippet) -> bool
+
+{
+    const char* id = snippet.id;
+    vector<uint1> payload = corpus::repeat (snippet, 64 * 1024);
+
+    auto coro = Coronium (id);
+    coro.load (payload.data(), payload.size());
+    BinaryRaw* bin = coro.getBinaryRawImage ();
+    bin->setBaseAddress (0x00000000);
+    Range rng = bin->getAddressRange (0, payload.size());
+
+    string path = string ("/tmp/pcode_roundtrip.") + to_string (getpid()) + ".bin";
+    coro.exportPcode (rng, path);
+    vector<Instruction> insns = coro.dump (rng);
+
+    bool ok = true;
+    {
+        PcodeReader reader (path);
+        size_t n = 0;
+        auto it = reader.begin();
+        for (; it != reader.end() && n != insns.size(); ++it, ++n) {
+            if (!check (reader, *it, insns[n])) {
+                cout << id << ": MISMATCH at " << hex << insns[n].assembly.address.getOffset()
+                     << dec << "\n";
+                ok = false;
+                break;
+            }
+        }
+        if (ok && (it != reader.end() || n != insns.size() || reader.size() != insns.size())) {
+            cout << id << ": MISMATCH in instruction count\n";
+            ok = false;
+        }
+        if (ok)
+            cout << id << ": " << n << " instructions OK\n";
+    }
+    remove (path.c_str());
+    return ok;
+}
+
+int main (int argc, char** argv)
+
+{
+    bool ok = true;
+    ok &= roundtrip (corpus::x86_64);
+    ok &= roundtrip (corpus::arm);
+    return ok ? 0 : 1;
+}
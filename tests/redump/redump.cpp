@@ -0,0 +1,89 @@
+/**
+ * @file redump.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Dumps a buffer of code (with the instruction cache enabled), patches the image
+ * through the BinaryRaw rather than Coronium::patch(), brings the dump up to date with
+ * Coronium::redump() and checks it against the dump of a Coronium that only ever saw
+ * the patched bytes. Exits with 1 on the first difference.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+static auto run (const corpus::Snippet& snippet, uintb at, const vector<uint1>& replacement) -> bool
+
+{
+    const char* id = snippet.id;
+    uintb size = snippet.bytes.size();
+    vector<uint1> payload = corpus::repeat (snippet, 16 * 1024);
+    // Leave room after the last snippet for instructions the patch makes longer.
+    uintb last = payload.size() - size;
+
+    auto coro = Coronium (id);
+    coro.load (payload.data(), payload.size());
+    coro.enableCache();
+    BinaryRaw* bin = coro.getBinaryRawImage();
+    vector<Instruction> insns = coro.dump (bin->getAddressRange (0, last));
+
+    vector<uint1> patched = payload;
+    for (uintb s : { (uintb)0, (uintb)1, 3000 / size, (last - 1) / size - 1 }) {
+        uintb off = s * size + at;
+        bin->patch (bin->getAddress (off), replacement.data(), replacement.size());
+        copy (replacement.begin(), replacement.end(), patched.begin() + off);
+    }
+    size_t ndecoded = coro.redump (insns, bin->getDirty());
+
+    auto ref = Coronium (id);
+    ref.load (patched.data(), patched.size());
+    vector<Instruction> want = ref.dump (ref.getBinaryRawImage()->getAddressRange (0, last));
+
+    if (!corpus::same (id, insns, want))
+        return false;
+    // Four patches, each costs a few instructions around it, not the whole dump.
+    if (ndecoded == 0 || ndecoded > 4 * 8) {
+        cout << id << ": MISMATCH, " << ndecoded << " instructions decoded again\n";
+        return false;
+    }
+    cout << id << ": " << ndecoded << " of " << insns.size() << " instructions decoded again, OK\n";
+    return true;
+}
+
+int main (int argc, char** argv)
+
+{
+    bool ok = true;
+    // push rbp; mov rbp,rsp patched to mov eax,imm32, which swallows a byte of the next
+    // instruction until the stream resynchronizes.
+    ok &= run (corpus::x86_64, 0, { 0xb8, 0x01, 0x00, 0x00 });
+    // mov r0,#0 patched to mov r0,#1
+    ok &= run (corpus::arm, 8, { 0x01, 0x00, 0xa0, 0xe3 });
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file sweep_lengths.cpp
+ * Copyright (C) 2022 Joe Staursky
+ *
+ * @section LICENSE
+ *
+ * This file is part of coronium.
+ *
+ * coronium is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * coronium is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * coronium. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Checks Coronium::sweepLengths() against the instructions of Coronium::dump() on an
+ * aligned ISA (ARM) when the sweep starts on an unaligned address, and when a gap
+ * between two regions ends on an unaligned address. No instruction may start on an
+ * unaligned address. Exits with 1 on the first difference.
+ */
+
+#include <coronium/coronium.hpp>
+#include <coronium/types.h>
+
+#include "../common/corpus.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace coronium;
+using namespace std;
+
+/*
+ * The sweep of rng must mark the instructions the dumps of the aligned ranges start,
+ * and nothing else.
+ */
+static auto check (const string& what, Coronium& coro, const Range& rng,
+                   const vector<Range>& aligned) -> bool
+
+{
+    BoundaryMap map = coro.sweepLengths (rng);
+    vector<uintb> want;
+    for (const Range& part : aligned)
+        coro.dump (part, [&] (Instruction const& insn) {
+            want.push_back (insn.assembly.address.getOffset() - rng.getFirst());
+            return true;
+        });
+    vector<uintb> got = map.offsets();
+    if (got != want) {
+        cout << what << ": MISMATCH, " << got.size() << " starts instead of " << want.size();
+        for (size_t n = 0; n != got.size() && n != want.size(); ++n)
+            if (got[n] != want[n]) {
+                cout << ", first at " << hex << rng.getFirst() + got[n] << dec;
+                break;
+            }
+        cout << "\n";
+        return false;
+    }
+    cout << what << ": " << got.size() << " instructions OK\n";
+    return true;
+}
+
+int main (int argc, char** argv)
+
+{
+    vector<uint1> payload = corpus::repeat (corpus::arm, 4096);
+    uintb size = payload.size();
+    // The second region starts 2 bytes before a copy of the code, on an unaligned
+    // address past a gap.
+    vector<uint1> extra (2, 0xff);
+    extra.insert (extra.end(), payload.begin(), payload.end());
+    const uintb base = size + 0x102;
+
+    auto coro = Coronium (corpus::arm.id);
+    coro.load (payload.data(), payload.size());
+    BinaryRaw* bin = coro.getBinaryRawImage();
+    bin->setBaseAddress (0x10000);
+    bin->addRegion (base, extra.data(), extra.size());
+
+    const uintb first = 0x10000;
+    const uintb end = first + size;
+    const uintb last = first + base + extra.size();
+    bool ok = check ("aligned start", coro, bin->getAddressRange (first, end),
+                     { bin->getAddressRange (first, end) });
+    ok &= check ("unaligned start", coro, bin->getAddressRange (first + 2, end),
+                 { bin->getAddressRange (first + 4, end) });
+    ok &= check ("unaligned start", coro, bin->getAddressRange (first + 1, end),
+                 { bin->getAddressRange (first + 4, end) });
+    // The jump over the gap lands 2 bytes before the next aligned address.
+    ok &= check ("gap ending unaligned", coro, bin->getAddressRange (end - 64, last),
+                 { bin->getAddressRange (end - 64, end),
+                   bin->getAddressRange (first + base + 2, last) });
+    return ok ? 0 : 1;
+}